@@ -0,0 +1,107 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fake_rtc_client.h"
+#include "fake_rtc_transform.h"
+
+#define NANOSECONDS_IN_SECOND 1000000000LL
+
+int fake_rtc_client_open(struct fake_rtc_client *client, const char *path) {
+    void *page;
+    client->fd = open(path != NULL ? path : FAKE_RTC_DEFAULT_DEVICE, O_RDONLY | O_CLOEXEC);
+    if (client->fd < 0) {
+        return -1;
+    }
+    page = mmap(NULL, (size_t)sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, client->fd, 0);
+    if (page == MAP_FAILED) {
+        int error = errno;
+        close(client->fd);
+        errno = error;
+        return -1;
+    }
+    client->page = page;
+    client->timeline = 0;
+    if (client->page->version != FAKE_RTC_PAGE_VERSION) {
+        fake_rtc_client_close(client);
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+void fake_rtc_client_close(struct fake_rtc_client *client) {
+    munmap((void *)client->page, (size_t)sysconf(_SC_PAGESIZE));
+    close(client->fd);
+    client->page = NULL;
+    client->fd = -1;
+}
+
+int fake_rtc_client_gettime(const struct fake_rtc_client *client, struct timespec *ts) {
+    const volatile struct fake_rtc_page *page = client->page;
+    uint32_t sequence;
+    uint32_t flags;
+    uint32_t shift;
+    int64_t mult;
+    int64_t real_time;
+    int64_t boot_time;
+    int64_t fake_time;
+    struct timespec monotonic;
+    do {
+        sequence = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            continue;
+        }
+        flags = page->flags;
+        shift = page->shift;
+        mult = page->mult;
+        real_time = page->real_time;
+        boot_time = page->boot_time;
+        if (clock_gettime(CLOCK_MONOTONIC, &monotonic)) {
+            return -1;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || __atomic_load_n(&page->sequence, __ATOMIC_RELAXED) != sequence);
+
+    /* Otherwise module calculates time, including private timeline of this open */
+    if (flags & FAKE_RTC_PAGE_VALID) {
+        int64_t now = monotonic.tv_sec * NANOSECONDS_IN_SECOND + monotonic.tv_nsec;
+        bool saturated;
+        /* Same transform as in module */
+        fake_time = fake_rtc_scale(real_time, (uint64_t)(now - boot_time), mult, shift, &saturated);
+        if (client->timeline) {
+            fake_time = fake_rtc_timeline_time(client->timeline_start, client->timeline_base_time, fake_time,
+                client->timeline_mult, client->timeline_shift, &saturated);
+        }
+    } else if (ioctl(client->fd, FAKE_RTC_GET_TIME, &fake_time)) {
+        return -1;
+    }
+    ts->tv_sec = fake_time / NANOSECONDS_IN_SECOND;
+    ts->tv_nsec = fake_time % NANOSECONDS_IN_SECOND;
+    return 0;
+}
+
+int fake_rtc_client_set_timeline(struct fake_rtc_client *client, int64_t offset, uint32_t num, uint32_t den) {
+    struct fake_rtc_timeline timeline = { .offset = offset, .num = num, .den = den };
+    bool saturated;
+    if (ioctl(client->fd, FAKE_RTC_SET_TIMELINE, &timeline)) {
+        return -1;
+    }
+    /* Same anchor and rate as module uses for FAKE_RTC_GET_TIME of this open */
+    fake_rtc_rate_to_fixed(num, den, &client->timeline_mult, &client->timeline_shift);
+    client->timeline_base_time = timeline.base_time;
+    client->timeline_start = fake_rtc_add_sat(timeline.base_time, offset, &saturated);
+    client->timeline = 1;
+    return 0;
+}
+
+int fake_rtc_client_clear_timeline(struct fake_rtc_client *client) {
+    if (ioctl(client->fd, FAKE_RTC_CLEAR_TIMELINE)) {
+        return -1;
+    }
+    client->timeline = 0;
+    return 0;
+}
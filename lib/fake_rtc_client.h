@@ -0,0 +1,77 @@
+#ifndef FAKE_RTC_CLIENT_H
+#define FAKE_RTC_CLIENT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "fake_rtc_uapi.h"
+
+#define FAKE_RTC_DEFAULT_DEVICE "/dev/" FAKE_RTC_DEVICE_NAME
+
+/**
+ * @brief Connection to /dev/fake_rtc
+ *
+ * @fd - opened device, used when page can't describe fake time
+ * @page - mapped read-only page with current transform
+ * @timeline - private timeline is set, see fake_rtc_client_set_timeline
+ * @timeline_start - time of private timeline at its anchor
+ * @timeline_base_time - fake time of device at anchor of private timeline
+ * @timeline_mult - fixed point rate of private timeline relative to device
+ * @timeline_shift - number of fractional bits in timeline_mult
+ */
+struct fake_rtc_client {
+    int fd;
+    const volatile struct fake_rtc_page *page;
+    int timeline;
+    int64_t timeline_start;
+    int64_t timeline_base_time;
+    int64_t timeline_mult;
+    uint32_t timeline_shift;
+};
+
+/**
+ * @brief Open device and map its page
+ *
+ * @param client - client to initialize
+ * @param path - path to device, FAKE_RTC_DEFAULT_DEVICE if NULL
+ * @return int - 0 on success, -1 with errno set otherwise
+ */
+int fake_rtc_client_open(struct fake_rtc_client *client, const char *path);
+
+void fake_rtc_client_close(struct fake_rtc_client *client);
+
+/**
+ * @brief Get current fake time
+ *
+ * Time is calculated in userspace from mapped page and CLOCK_MONOTONIC, so it costs as much as vDSO call.
+ * Device is asked only when fake time is not linear (random mode)
+ *
+ * @param client - opened client
+ * @param ts - where to store time from January 1st 1970
+ * @return int - 0 on success, -1 with errno set otherwise
+ */
+int fake_rtc_client_gettime(const struct fake_rtc_client *client, struct timespec *ts);
+
+/**
+ * @brief Give this client its own timeline layered on fake time of device
+ *
+ * From now on client sees fake time of device at this moment plus offset, running num / den times as fast
+ * as fake time of device. Other clients and processes are not affected. Time is still calculated from mapped page
+ *
+ * @param client - opened client
+ * @param offset - nanoseconds added to fake time of device
+ * @param num - numerator of rate, not zero
+ * @param den - denominator of rate, not zero
+ * @return int - 0 on success, -1 with errno set otherwise
+ */
+int fake_rtc_client_set_timeline(struct fake_rtc_client *client, int64_t offset, uint32_t num, uint32_t den);
+
+/**
+ * @brief Return client to fake time of device
+ *
+ * @param client - opened client
+ * @return int - 0 on success, -1 with errno set otherwise
+ */
+int fake_rtc_client_clear_timeline(struct fake_rtc_client *client);
+
+#endif
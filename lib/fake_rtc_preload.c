@@ -0,0 +1,58 @@
+/**
+ * LD_PRELOAD shim replacing CLOCK_REALTIME of a process with fake time of /dev/fake_rtc
+ *
+ * Usage: LD_PRELOAD=libfakertc_preload.so FAKE_RTC_DEVICE=/dev/fake_rtc program
+ * If device can't be opened, all calls are passed to libc unchanged
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "fake_rtc_client.h"
+
+static struct fake_rtc_client client;
+static int client_ready;
+static pthread_once_t client_once = PTHREAD_ONCE_INIT;
+static int (*real_clock_gettime)(clockid_t, struct timespec *);
+
+static void client_init(void) {
+    real_clock_gettime = (int (*)(clockid_t, struct timespec *))dlsym(RTLD_NEXT, "clock_gettime");
+    client_ready = fake_rtc_client_open(&client, getenv("FAKE_RTC_DEVICE")) == 0;
+}
+
+static int is_realtime(clockid_t clock_id) {
+    return clock_id == CLOCK_REALTIME || clock_id == CLOCK_REALTIME_COARSE;
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec *ts) {
+    pthread_once(&client_once, client_init);
+    if (client_ready && is_realtime(clock_id)) {
+        return fake_rtc_client_gettime(&client, ts);
+    }
+    return real_clock_gettime(clock_id, ts);
+}
+
+int gettimeofday(struct timeval *restrict tv, void *restrict tz) {
+    struct timespec ts;
+    (void)tz;
+    if (clock_gettime(CLOCK_REALTIME, &ts)) {
+        return -1;
+    }
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+    return 0;
+}
+
+time_t time(time_t *tloc) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_REALTIME, &ts)) {
+        return (time_t)-1;
+    }
+    if (tloc != NULL) {
+        *tloc = ts.tv_sec;
+    }
+    return ts.tv_sec;
+}
@@ -1,296 +1,3460 @@
+#include <linux/atomic.h>
+#include <linux/capability.h>
+#include <linux/compat.h>
+#include <linux/configfs.h>
+#include <linux/debugfs.h>
+#include <linux/gcd.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/firmware.h>
+#include <linux/gfp.h>
+#include <linux/hashtable.h>
+#include <linux/hrtimer.h>
+#include <linux/jump_label.h>
 #include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
 #include <linux/random.h>
+#include <linux/rcupdate.h>
 #include <linux/rtc.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/overflow.h>
+#include <linux/percpu.h>
+#include <linux/pid_namespace.h>
 #include <linux/platform_device.h>
+#include <linux/poll.h>
 #include <linux/proc_fs.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/seq_file.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+
+#include "fake_rtc_transform.h"
+#include "fake_rtc_uapi.h"
+
+#define DEVICE_NAME "FakeRTC"
+#define NANOSECONDS_IN_SECOND 1000000000
+#define PPB_IN_ONE 1000000000LL
+#define MAX_CORRECTION_PPB 500000000
+#define RANDOM_BATCH_SIZE 64
+#define PROC_WRITE_MAX_LEN 4096
+#define DEFAULT_PIE_FREQ 64
+#define MAX_PIE_FREQ 8192
+#define MIN_PIE_PERIOD_NS 10000
+#define MAX_SCHEDULE_SEGMENTS 1024
+#define MAX_SCHEDULE_LENGTH (KTIME_MAX / 2)
+#define MAX_TRACE_SAMPLES (1 << 22)
+#define OSCILLATOR_UPDATE_MS 100
+#define MAX_JITTER_NS NSEC_PER_SEC
+#define MAX_SAMPLE_SPAN (KTIME_MAX / 2)
+#define LATENCY_BUCKETS 32
+#define VIEWS_HASH_BITS 8
+
+/**
+ * @brief Enum of operating modes for this module
+ * 
+ * Real - for real time, corresponding to system time
+ * Random - for randomized time from last sychronization
+ * Accelerated - time goes faster than real. How much faster - defined by accelerating_rate parameter
+ * Slowed - time goes slower than real. How much slower - defined by slowing_rate parameter
+ * Schedule - time follows uploaded timeline of segments with their own rates and jumps, see struct fake_rtc_schedule
+ * Trace - real time with offsets replayed from recorded trace, see struct fake_rtc_trace
+ */
+enum fake_rtc_mode {
+    REAL,
+    RANDOM,
+    ACCELERATED,
+    SLOWED,
+    SCHEDULE,
+    TRACE,
+    MODES_NUMBER
+};
+
+#define CREATE_TRACE_POINTS
+#include "fake_rtc_trace.h"
+
+/**
+ * @brief Rate of fake time as rational number: how many fake nanoseconds pass in num / den real ones
+ * 
+ * Both fields are positive
+ */
+struct fake_rtc_rate {
+    u32 num;
+    u32 den;
+};
+
+/**
+ * @brief Timeline of schedule mode
+ * 
+ * Schedule is relative to synchronization point, so it starts again after time set.
+ * It is never changed after upload: new schedule replaces old one, which is freed after RCU grace period
+ * 
+ * @rcu - used to free replaced schedule
+ * @count - number of segments, at least one
+ * @segments - segments sorted by real_start, first one starts at 0. The last one lasts forever
+ */
+struct fake_rtc_schedule {
+    struct rcu_head rcu;
+    unsigned int count;
+    struct fake_rtc_segment segments[];
+};
+
+/**
+ * @brief Loaded trace of trace mode
+ * 
+ * Trace is decoded from delta-encoded file once on load, so reading time finds sample by its index
+ * and interpolates linearly between two neighbouring samples, see fake_rtc_trace_offset.
+ * Like schedule, trace is never changed after load and is freed after RCU grace period
+ * 
+ * @rcu - used to free replaced trace
+ * @samples - parameters of trace, its offsets point to offsets of this struct
+ * @offsets - offset of fake time from real one at every sample in nanoseconds
+ */
+struct fake_rtc_trace {
+    struct rcu_head rcu;
+    struct fake_rtc_samples samples;
+    s64 offsets[];
+};
+
+/**
+ * @brief Model of crystal oscillator drifting from nominal frequency
+ * 
+ * Frequency error is sum of constant skew, sinusoidal wander (like daily temperature changes) and random walk.
+ * It is recalculated every OSCILLATOR_UPDATE_MS and folded into multiplier of anchor together with PTP correction,
+ * so reading time doesn't pay for the model. Phase of wander is function of fake time, zero at January 1st 1970,
+ * so wander is accelerated together with clock and is reproduced exactly after time set.
+ * Changed only inside write section of anchor_lock of instance
+ * 
+ * @skew_ppb - constant frequency error in parts per billion
+ * @wander_ppb - amplitude of sinusoidal wander in parts per billion
+ * @wander_period - period of wander in fake nanoseconds
+ * @walk_step_ppb - largest change of random walk per update in parts per billion
+ * @walk_limit_ppb - largest absolute value of random walk in parts per billion
+ * @walk_ppb - current value of random walk in parts per billion
+ */
+struct fake_rtc_oscillator {
+    s32 skew_ppb;
+    s32 wander_ppb;
+    u64 wander_period;
+    s32 walk_step_ppb;
+    s32 walk_limit_ppb;
+    s64 walk_ppb;
+};
+
+/**
+ * @brief Synchronization point of fake time together with the mode it is interpreted under
+ *
+ * These fields are always published together under anchor_lock of instance, so reader never
+ * combines new real time with old boot time or with mode which was not active at that moment
+ *
+ * @synchronized_real_time - time is nanoseconds used as starting point in time measurement. Synchronization takes place in init and time set
+ * @synchronized_boot_time - time in nanoseconds used to calculate time difference between measurement and synchronization which takes place in init and time set
+ * @mode - current operating mode
+ * @mult - fixed point rate of current mode, negative for time going backwards. See fake_rtc_rate_to_fixed
+ * @shift - number of fractional bits in mult
+ * @inverse_mult - fixed point value of 1 / rate, used to find real moment of fake time. Always positive
+ * @inverse_shift - number of fractional bits in inverse_mult
+ * @random_min - smallest coefficient of random mode
+ * @random_range - number of possible coefficients of random mode, from 1 to 2^32
+ * @schedule - timeline of schedule mode, NULL if it was never uploaded. Dereferenced only inside rcu_read_lock
+ * @trace - offsets of trace mode, NULL if it was never loaded. Dereferenced only inside rcu_read_lock
+ * @jitter - bound of random error added to every read in nanoseconds, 0 if disabled
+ */
+struct fake_rtc_anchor {
+    ktime_t synchronized_real_time;
+    ktime_t synchronized_boot_time;
+    enum fake_rtc_mode mode;
+    s64 mult;
+    u32 shift;
+    s64 inverse_mult;
+    u32 inverse_shift;
+    s32 random_min;
+    u64 random_range;
+    struct fake_rtc_schedule __rcu *schedule;
+    struct fake_rtc_trace __rcu *trace;
+    u32 jitter;
+};
+
+/**
+ * @brief Operation counters of one instance
+ * 
+ * Counters are per-CPU, so every CPU increments its own copy without atomics and cache line bouncing.
+ * They are summed only when somebody reads status of instance, see fake_rtc_sum_counters
+ * 
+ * @read - number of time reads
+ * @set - number of time sets
+ * @mode_change - number of mode changes
+ * @saturated - number of reads which result was saturated at range limits
+ * @pie_missed - number of periodic interrupts of /dev/fake_rtc coalesced because reader was late
+ */
+struct fake_rtc_counters {
+    u64 read;
+    u64 set;
+    u64 mode_change;
+    u64 saturated;
+    u64 pie_missed;
+};
+
+/**
+ * @brief One fake clock with its own timeline, configuration and devices
+ * 
+ * Default instance is created on module load and serves /proc/FakeRTC, /dev/fake_rtc and module parameters.
+ * Other instances are created and removed at runtime with mkdir and rmdir in configfs, see fake_rtc_make_item.
+ * Instances are allocated from their own slab cache, and PTP clock of configfs instance is registered
+ * only on request, so thousands of instances are cheap.
+ * Data used by every time read starts on its own cache line and is only written on configuration changes.
+ * Frequently written data (counters, random generators) is per-CPU, so reads don't invalidate anchor on other CPUs
+ * 
+ * @anchor_lock - seqlock protecting anchor. Readers never take it, they only retry if writer was active.
+ *                Alarm and periodic interrupt timers read anchor in hardirq context, so writers disable interrupts
+ * @anchor_lock_flags - interrupt state saved by anchor_write_begin, used only by the writer holding anchor_lock
+ * @anchor - synchronization point and mode, see struct fake_rtc_anchor
+ * @rates - rate of each mode. Changed under anchor_lock together with anchor multiplier
+ * @correction_ppb - frequency correction of all modes in parts per billion, set by PTP clients. Changed under anchor_lock
+ * @offset_ppb - frequency trim of all modes in parts per billion, set through RTC offset interface.
+ *               As in RTC ABI, positive trim makes clock slower. Changed under anchor_lock
+ * @oscillator - model of frequency drift, see struct fake_rtc_oscillator
+ * @drift_ppb - current frequency error of oscillator model in parts per billion. Changed under anchor_lock
+ * @oscillator_work - periodic update of drift_ppb, scheduled while wander or random walk is enabled
+ * @counters - per-CPU operation counters, see struct fake_rtc_counters
+ * @rtc_dev - rtc device registered in kernel
+ * @ptp_info - description of PTP clock, used to find instance in PTP callbacks
+ * @ptp_clock - PTP clock giving nanosecond access to fake time, NULL if it is not registered
+ * @page - page with copy of anchor mapped by userspace clients of /dev/fake_rtc, NULL if instance has no such clients.
+ *         Updated under anchor_lock
+ * @alarm_timer - timer firing when fake time reaches alarm_time
+ * @alarm_time - fake time of alarm in nanoseconds from January 1st 1970
+ * @alarm_enabled - alarm is enabled
+ * @pdev - registered platform device used to register rtc device
+ * @item - configfs item of instance, not used by default instance
+ * @pid_ns - pid namespace which sees this instance through devices of default instance, NULL if not bound.
+ *          Changed under fake_rtc_instances_mutex
+ * @view_node - node in fake_rtc_views, hashed by pid_ns
+ */
+struct fake_rtc_instance {
+    seqlock_t anchor_lock ____cacheline_aligned_in_smp;
+    unsigned long anchor_lock_flags;
+    struct fake_rtc_anchor anchor;
+    struct fake_rtc_rate rates[MODES_NUMBER];
+    s64 correction_ppb;
+    s64 offset_ppb;
+    struct fake_rtc_oscillator oscillator;
+    s64 drift_ppb;
+    struct delayed_work oscillator_work;
+    struct fake_rtc_counters __percpu *counters;
+    struct rtc_device *rtc_dev;
+    struct ptp_clock_info ptp_info;
+    struct ptp_clock *ptp_clock;
+    struct fake_rtc_page *page;
+    struct hrtimer alarm_timer;
+    ktime_t alarm_time;
+    bool alarm_enabled;
+    struct platform_device *pdev;
+    struct config_item item;
+    struct pid_namespace *pid_ns;
+    struct hlist_node view_node;
+};
+
+/**
+ * Rates and random bounds given as module parameters. They are applied to default instance immediately
+ * and are initial configuration of every new instance
+ */
+static struct fake_rtc_rate fake_rtc_rates[MODES_NUMBER] = {
+    [REAL] = { 1, 1 },
+    [RANDOM] = { 1, 1 },
+    [ACCELERATED] = { 2, 1 },
+    [SLOWED] = { 1, 5 },
+    [SCHEDULE] = { 1, 1 },
+    [TRACE] = { 1, 1 }
+};
+static s32 fake_rtc_random_min = -9;
+static u64 fake_rtc_random_range = 19;
+
+static struct kmem_cache *fake_rtc_instance_cache;
+/* Instance created on module load, see struct fake_rtc_instance */
+static struct fake_rtc_instance *fake_rtc_default;
+/* Serializes changes of module parameters, registration of PTP clocks and binding of pid namespaces of configfs instances */
+static DEFINE_MUTEX(fake_rtc_instances_mutex);
+static struct proc_dir_entry *fake_rtc_proc_entry;
+static struct dentry *fake_rtc_debugfs_dir;
+
+/**
+ * Configfs instances bound to pid namespaces. Tasks of bound namespace reading or setting time through devices
+ * of default instance get time of bound instance, so one /dev/rtcN serves many containers with isolated timelines.
+ * Lookup is skipped by static key while nothing is bound
+ */
+static DEFINE_HASHTABLE(fake_rtc_views, VIEWS_HASH_BITS);
+static DEFINE_STATIC_KEY_FALSE(fake_rtc_views_enabled);
+
+/**
+ * @brief Find instance which current task sees through devices of given instance
+ * 
+ * Must be called under rcu_read_lock. Bound instance is not freed until rcu_read_unlock
+ * 
+ * @param instance - instance of accessed device
+ * @return struct fake_rtc_instance* - instance bound to pid namespace of current task or given instance
+ */
+static struct fake_rtc_instance *fake_rtc_view(struct fake_rtc_instance *instance) {
+    struct pid_namespace *ns;
+    struct fake_rtc_instance *bound;
+    if (!static_branch_unlikely(&fake_rtc_views_enabled) || instance != fake_rtc_default) {
+        return instance;
+    }
+    ns = task_active_pid_ns(current);
+    hash_for_each_possible_rcu(fake_rtc_views, bound, view_node, (unsigned long)ns) {
+        if (READ_ONCE(bound->pid_ns) == ns) {
+            return bound;
+        }
+    }
+    return instance;
+}
+
+/**
+ * @brief Check whether current task sees another instance through devices of given instance
+ * 
+ * Alarm of instance lives in timer queue of its RTC device, which is shared by all namespaces,
+ * so tasks of bound namespaces can't set it in time of their own instance
+ * 
+ * @param instance - instance of accessed device
+ * @return bool - true if pid namespace of current task is bound to another instance
+ */
+static bool fake_rtc_view_is_bound(struct fake_rtc_instance *instance) {
+    bool bound;
+    rcu_read_lock();
+    bound = fake_rtc_view(instance) != instance;
+    rcu_read_unlock();
+    return bound;
+}
+
+#if IS_ENABLED(CONFIG_CONFIGFS_FS)
+
+/**
+ * @brief Take reference to configfs instance found by fake_rtc_view
+ * 
+ * @param instance - configfs instance
+ * @return bool - false if instance is being released
+ */
+static bool fake_rtc_instance_get(struct fake_rtc_instance *instance) {
+    return config_item_get_unless_zero(&instance->item) != NULL;
+}
+
+static void fake_rtc_instance_put(struct fake_rtc_instance *instance) {
+    config_item_put(&instance->item);
+}
+
+#else
+
+static bool fake_rtc_instance_get(struct fake_rtc_instance *instance) {
+    return false;
+}
+
+static void fake_rtc_instance_put(struct fake_rtc_instance *instance) {
+}
+
+#endif
+
+/**
+ * @brief Sum counters of all CPUs
+ * 
+ * Result is not an atomic snapshot, but every counter is exact as long as there is no concurrent increments
+ * 
+ * @param instance - instance which counters are summed
+ * @param sum - where to store totals
+ */
+static void fake_rtc_sum_counters(struct fake_rtc_instance *instance, struct fake_rtc_counters *sum) {
+    int cpu;
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        const struct fake_rtc_counters *counters = per_cpu_ptr(instance->counters, cpu);
+        sum->read += counters->read;
+        sum->set += counters->set;
+        sum->mode_change += counters->mode_change;
+        sum->saturated += counters->saturated;
+        sum->pie_missed += counters->pie_missed;
+    }
+}
+
+/**
+ * @brief Detailed statistics of all instances, collected only while enabled in debugfs
+ * 
+ * Like counters, statistics are per-CPU and summed on read. Bucket i of histogram counts operations
+ * which took [2^(i-1), 2^i) nanoseconds, the last bucket also counts all longer ones
+ * 
+ * @read_latency - histogram of time read latency
+ * @set_latency - histogram of time set latency
+ * @read_max - largest time read latency in nanoseconds
+ * @set_max - largest time set latency in nanoseconds
+ * @mode_reads - number of time reads in every mode
+ * @mode_changes - number of changes to every mode
+ */
+struct fake_rtc_stats {
+    u64 read_latency[LATENCY_BUCKETS];
+    u64 set_latency[LATENCY_BUCKETS];
+    u64 read_max;
+    u64 set_max;
+    u64 mode_reads[MODES_NUMBER];
+    u64 mode_changes[MODES_NUMBER];
+};
+
+static DEFINE_PER_CPU(struct fake_rtc_stats, fake_rtc_stats);
+
+/**
+ * Statistics are disabled by default and cost only a patched out jump on read path
+ */
+static DEFINE_STATIC_KEY_FALSE(fake_rtc_stats_enabled);
+
+/**
+ * @brief Start measuring latency of operation
+ * 
+ * @return u64 - start of operation in nanoseconds of CLOCK_MONOTONIC, 0 if statistics are disabled
+ */
+static __always_inline u64 fake_rtc_stats_start(void) {
+    if (static_branch_unlikely(&fake_rtc_stats_enabled)) {
+        return ktime_get_ns();
+    }
+    return 0;
+}
+
+/**
+ * @brief Account latency of operation in histogram of this CPU
+ * 
+ * @param histogram - histogram of this CPU
+ * @param max - largest latency of this CPU
+ * @param start - result of fake_rtc_stats_start
+ */
+static void fake_rtc_stats_account(u64 *histogram, u64 *max, u64 start) {
+    u64 latency = ktime_get_ns() - start;
+    histogram[min_t(unsigned int, fls64(latency), LATENCY_BUCKETS - 1)]++;
+    if (latency > *max) {
+        *max = latency;
+    }
+}
+
+/**
+ * @brief Finish measuring latency of time read
+ * 
+ * Statistics are dropped if they were enabled in the middle of operation
+ * 
+ * @param start - result of fake_rtc_stats_start
+ * @param mode - mode in which time was read
+ */
+static __always_inline void fake_rtc_stats_read(u64 start, enum fake_rtc_mode mode) {
+    if (static_branch_unlikely(&fake_rtc_stats_enabled) && start != 0) {
+        struct fake_rtc_stats *stats = get_cpu_ptr(&fake_rtc_stats);
+        fake_rtc_stats_account(stats->read_latency, &stats->read_max, start);
+        stats->mode_reads[mode]++;
+        put_cpu_ptr(&fake_rtc_stats);
+    }
+}
+
+/**
+ * @brief Finish measuring latency of time set
+ * 
+ * @param start - result of fake_rtc_stats_start
+ */
+static __always_inline void fake_rtc_stats_set(u64 start) {
+    if (static_branch_unlikely(&fake_rtc_stats_enabled) && start != 0) {
+        struct fake_rtc_stats *stats = get_cpu_ptr(&fake_rtc_stats);
+        fake_rtc_stats_account(stats->set_latency, &stats->set_max, start);
+        put_cpu_ptr(&fake_rtc_stats);
+    }
+}
+
+/**
+ * @brief Account change of mode
+ * 
+ * @param mode - new mode
+ */
+static void fake_rtc_stats_mode_change(enum fake_rtc_mode mode) {
+    if (static_branch_unlikely(&fake_rtc_stats_enabled)) {
+        this_cpu_inc(fake_rtc_stats.mode_changes[mode]);
+    }
+}
+
+/**
+ * @brief Sum statistics of all CPUs
+ * 
+ * @param sum - where to store totals, maximums are maximums of all CPUs
+ */
+static void fake_rtc_sum_stats(struct fake_rtc_stats *sum) {
+    int cpu;
+    int i;
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        const struct fake_rtc_stats *stats = per_cpu_ptr(&fake_rtc_stats, cpu);
+        for (i = 0; i < LATENCY_BUCKETS; i++) {
+            sum->read_latency[i] += stats->read_latency[i];
+            sum->set_latency[i] += stats->set_latency[i];
+        }
+        sum->read_max = max(sum->read_max, stats->read_max);
+        sum->set_max = max(sum->set_max, stats->set_max);
+        for (i = 0; i < MODES_NUMBER; i++) {
+            sum->mode_reads[i] += stats->mode_reads[i];
+            sum->mode_changes[i] += stats->mode_changes[i];
+        }
+    }
+}
+
+/**
+ * @brief Get consistent copy of anchor
+ *
+ * Lock-free for reader: it only retries if time set or mode change happened concurrently
+ *
+ * @param instance - instance of fake clock
+ * @param anchor - where to store the copy
+ */
+static void fake_rtc_read_anchor(struct fake_rtc_instance *instance, struct fake_rtc_anchor *anchor) {
+    unsigned int seq;
+    do {
+        seq = read_seqbegin(&instance->anchor_lock);
+        *anchor = instance->anchor;
+    } while (read_seqretry(&instance->anchor_lock, seq));
+}
+
+/**
+ * @brief Check if fake time of mode is linear function of real time given by anchor
+ * 
+ * @param mode - mode to check
+ * @return bool - true for real, accelerated and slowed modes
+ */
+static bool fake_rtc_mode_is_linear(enum fake_rtc_mode mode) {
+    return mode == REAL || mode == ACCELERATED || mode == SLOWED;
+}
+
+/**
+ * @brief Check if mode follows uploaded timeline which starts at synchronization point
+ * 
+ * @param mode - mode to check
+ * @return bool - true for schedule and trace modes
+ */
+static bool fake_rtc_mode_has_timeline(enum fake_rtc_mode mode) {
+    return mode == SCHEDULE || mode == TRACE;
+}
+
+/**
+ * @brief Copy anchor to page shared with userspace
+ * 
+ * Page has its own sequence counter, because userspace can't use kernel seqlock.
+ * Page can't reproduce jitter, so it is marked invalid while jitter is enabled
+ * Must be called inside write section of anchor_lock of instance
+ */
+static void publish_page_locked(struct fake_rtc_instance *instance) {
+    struct fake_rtc_page *page = instance->page;
+    u32 sequence;
+    if (page == NULL) {
+        return;
+    }
+    sequence = page->sequence;
+    WRITE_ONCE(page->sequence, sequence + 1);
+    smp_wmb();
+    page->flags = fake_rtc_mode_is_linear(instance->anchor.mode) && instance->anchor.jitter == 0 ? FAKE_RTC_PAGE_VALID : 0;
+    page->shift = instance->anchor.shift;
+    page->mult = instance->anchor.mult;
+    page->real_time = instance->anchor.synchronized_real_time;
+    page->boot_time = instance->anchor.synchronized_boot_time;
+    smp_wmb();
+    WRITE_ONCE(page->sequence, sequence + 2);
+}
+
+/**
+ * @brief Begin change of anchor
+ * 
+ * Interrupts are disabled: otherwise timer callback reading anchor on this CPU would spin forever
+ * on odd sequence of interrupted writer
+ */
+static void anchor_write_begin(struct fake_rtc_instance *instance) {
+    unsigned long flags;
+    write_seqlock_irqsave(&instance->anchor_lock, flags);
+    instance->anchor_lock_flags = flags;
+}
+
+/**
+ * @brief Leave write section of anchor without changes
+ * 
+ * Unlike anchor_write_end, anchor is not published and alarm is not rearmed, because nothing changed
+ */
+static void anchor_write_abort(struct fake_rtc_instance *instance) {
+    write_sequnlock_irqrestore(&instance->anchor_lock, instance->anchor_lock_flags);
+}
+
+static void rearm_alarm_timer(struct fake_rtc_instance *instance);
+
+/**
+ * @brief Finish change of anchor and publish it to userspace
+ * 
+ * Real moment of alarm depends on anchor, so alarm timer is rearmed
+ */
+static void anchor_write_end(struct fake_rtc_instance *instance) {
+    trace_fake_rtc_transform(instance->anchor.mode, instance->anchor.mult, instance->anchor.shift,
+        instance->anchor.synchronized_real_time, instance->anchor.synchronized_boot_time);
+    publish_page_locked(instance);
+    write_sequnlock_irqrestore(&instance->anchor_lock, instance->anchor_lock_flags);
+    rearm_alarm_timer(instance);
+}
+
+/**
+ * @brief Set new synchronization point
+ *
+ * Boot time is taken inside write section so both values are published together
+ *
+ * @param instance - instance of fake clock
+ * @param real_time - time in nanoseconds from January 1st 1970 which corresponds to current moment
+ */
+static void synchronize_time(struct fake_rtc_instance *instance, ktime_t real_time) {
+    anchor_write_begin(instance);
+    instance->anchor.synchronized_real_time = real_time;
+    instance->anchor.synchronized_boot_time = ktime_get();
+    trace_fake_rtc_set(instance->anchor.synchronized_boot_time, real_time);
+    anchor_write_end(instance);
+}
+
+/**
+ * @brief Recalculate multiplier of anchor for its mode
+ * 
+ * Rate of mode is corrected by correction_ppb, drift_ppb and negated offset_ppb of instance,
+ * so corrections cost nothing on read
+ * Must be called inside write section of anchor_lock of instance
+ */
+static void update_transform_locked(struct fake_rtc_instance *instance) {
+    const struct fake_rtc_rate *rate = &instance->rates[instance->anchor.mode];
+    s64 correction = clamp_t(s64, instance->correction_ppb - instance->offset_ppb + instance->drift_ppb,
+        -MAX_CORRECTION_PPB, MAX_CORRECTION_PPB);
+    u64 num = (u64)rate->num * (PPB_IN_ONE + correction);
+    u64 den = (u64)rate->den * PPB_IN_ONE;
+    fake_rtc_rate_to_fixed(num, den, &instance->anchor.mult, &instance->anchor.shift);
+    fake_rtc_rate_to_fixed(den, num, &instance->anchor.inverse_mult, &instance->anchor.inverse_shift);
+}
+
+/**
+ * @brief Shift fake time by given value in any mode
+ * 
+ * Result is saturated at range limits of this device
+ * Must be called inside write section of anchor_lock of instance
+ * 
+ * @param instance - instance of fake clock
+ * @param delta - nanoseconds to add to fake time
+ */
+static void shift_time_locked(struct fake_rtc_instance *instance, s64 delta) {
+    bool saturated;
+    instance->anchor.synchronized_real_time = fake_rtc_add_sat(instance->anchor.synchronized_real_time, delta, &saturated);
+}
+
+/**
+ * @brief Parse rate from string
+ * 
+ * Accepted formats are natural number ("2"), fraction ("37/10") and decimal fraction ("1.0001")
+ * Decimal part may contain only digits. Fraction is reduced so num and den stay small
+ * 
+ * @param str - string to parse, may have surrounding whitespaces
+ * @param rate - where to store parsed rate
+ * @return int - status
+ */
+static int fake_rtc_parse_rate(const char *str, struct fake_rtc_rate *rate) {
+    char buf[32];
+    char *numerator;
+    char *separator;
+    u64 num;
+    u32 den = 1;
+    unsigned long divisor;
+    if (strscpy(buf, str, sizeof(buf)) < 0) {
+        return -EINVAL;
+    }
+    numerator = strim(buf);
+    separator = strpbrk(numerator, "/.");
+    if (separator == NULL) {
+        if (kstrtou64(numerator, 10, &num)) {
+            return -EINVAL;
+        }
+    } else if (*separator == '/') {
+        *separator = '\0';
+        if (kstrtou64(numerator, 10, &num) || kstrtou32(separator + 1, 10, &den)) {
+            return -EINVAL;
+        }
+    } else {
+        u32 fraction;
+        size_t digits = strlen(separator + 1);
+        *separator = '\0';
+        if (digits == 0 || digits > 9 || strspn(separator + 1, "0123456789") != digits || kstrtou64(numerator, 10, &num) || kstrtou32(separator + 1, 10, &fraction)) {
+            return -EINVAL;
+        }
+        while (digits--) {
+            den *= 10;
+        }
+        if (check_mul_overflow(num, (u64)den, &num) || check_add_overflow(num, (u64)fraction, &num)) {
+            return -ERANGE;
+        }
+    }
+    if (num == 0 || den == 0) {
+        return -EINVAL;
+    }
+    divisor = gcd(num, den);
+    num /= divisor;
+    den /= divisor;
+    if (num > U32_MAX) {
+        return -ERANGE;
+    }
+    rate->num = num;
+    rate->den = den;
+    return 0;
+}
+
+/**
+ * @brief set function for rate module parameters
+ * 
+ * Rate becomes initial rate of new instances. In default instance it is applied immediately if its mode is current
+ * 
+ * @param val - rate string, see fake_rtc_parse_rate
+ * @param kp - parameter, its arg points to element of fake_rtc_rates
+ * @return int - status
+ */
+static int fake_rtc_rate_param_set(const char *val, const struct kernel_param *kp) {
+    struct fake_rtc_rate *target = kp->arg;
+    enum fake_rtc_mode mode = target - fake_rtc_rates;
+    struct fake_rtc_instance *instance = fake_rtc_default;
+    struct fake_rtc_rate rate;
+    int status = fake_rtc_parse_rate(val, &rate);
+    if (status) {
+        return status;
+    }
+    mutex_lock(&fake_rtc_instances_mutex);
+    *target = rate;
+    mutex_unlock(&fake_rtc_instances_mutex);
+    if (instance == NULL) {
+        return 0;
+    }
+    anchor_write_begin(instance);
+    instance->rates[mode] = rate;
+    if (mode == instance->anchor.mode) {
+        update_transform_locked(instance);
+    }
+    anchor_write_end(instance);
+    return 0;
+}
+
+/**
+ * @brief get function for rate module parameters
+ * 
+ * Shows rate of default instance, which may be changed through /proc/FakeRTC after module parameter
+ */
+static int fake_rtc_rate_param_get(char *buffer, const struct kernel_param *kp) {
+    const struct fake_rtc_rate *target = kp->arg;
+    struct fake_rtc_instance *instance = fake_rtc_default;
+    struct fake_rtc_rate rate = *target;
+    unsigned int seq;
+    if (instance != NULL) {
+        do {
+            seq = read_seqbegin(&instance->anchor_lock);
+            rate = instance->rates[target - fake_rtc_rates];
+        } while (read_seqretry(&instance->anchor_lock, seq));
+    }
+    return sprintf(buffer, "%u/%u\n", rate.num, rate.den);
+}
+
+static const struct kernel_param_ops fake_rtc_rate_param_ops = {
+    .set = fake_rtc_rate_param_set,
+    .get = fake_rtc_rate_param_get
+};
+
+module_param_cb(accelerating_rate, &fake_rtc_rate_param_ops, &fake_rtc_rates[ACCELERATED], 0644);
+MODULE_PARM_DESC(accelerating_rate, "Rate of accelerated mode: \"2\", \"37/10\" or \"1.0001\"");
+module_param_cb(slowing_rate, &fake_rtc_rate_param_ops, &fake_rtc_rates[SLOWED], 0644);
+MODULE_PARM_DESC(slowing_rate, "Rate of slowed mode: \"1/5\", \"1/3600\" or \"0.2\"");
+
+/**
+ * @brief Linear transform of elapsed time with rate of anchor
+ * 
+ * @param anchor - synchronization point and rate
+ * @param nanoseconds_difference - nanoseconds from last synchronization
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static ktime_t fake_rtc_transform(const struct fake_rtc_anchor *anchor, u64 nanoseconds_difference, bool *saturated) {
+    return fake_rtc_scale(anchor->synchronized_real_time, nanoseconds_difference, anchor->mult, anchor->shift, saturated);
+}
+
+/**
+ * @brief Inverse of fake_rtc_transform for linear part of mode
+ * 
+ * Random coefficients are not taken into account, random mode is inverted as real one
+ * 
+ * @param anchor - synchronization point and rate
+ * @param fake_time - time from January 1st 1970
+ * @return ktime_t - first moment (by ktime_get) when fake time is not less than fake_time,
+ *                   synchronized_boot_time if it was reached before synchronization
+ */
+static ktime_t fake_rtc_inverse_transform(const struct fake_rtc_anchor *anchor, ktime_t fake_time) {
+    return fake_rtc_inverse_scale(anchor->synchronized_real_time, anchor->synchronized_boot_time, fake_time,
+        anchor->inverse_mult, anchor->inverse_shift);
+}
+
+/**
+ * @brief Fake time at given moment in mode of anchor
+ * 
+ * Random coefficients are not applied here, see fake_rtc_get_time
+ * Must be called inside rcu_read_lock, because schedule or trace of anchor may be used
+ * 
+ * @param anchor - synchronization point and mode
+ * @param boot_time - moment (by ktime_get) not before synchronization
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static ktime_t fake_rtc_time_at(const struct fake_rtc_anchor *anchor, ktime_t boot_time, bool *saturated) {
+    u64 nanoseconds_difference = boot_time - anchor->synchronized_boot_time;
+    const struct fake_rtc_schedule *schedule;
+    switch (anchor->mode) {
+    case SCHEDULE:
+        schedule = rcu_dereference(anchor->schedule);
+        return fake_rtc_schedule_time(anchor->synchronized_real_time, schedule->segments, schedule->count,
+            nanoseconds_difference, saturated);
+    case TRACE:
+        return fake_rtc_trace_time(anchor->synchronized_real_time, &rcu_dereference(anchor->trace)->samples,
+            nanoseconds_difference, saturated);
+    default:
+        return fake_rtc_transform(anchor, nanoseconds_difference, saturated);
+    }
+}
+
+/**
+ * @brief Find real moment when fake time reaches given value in mode of anchor
+ * 
+ * Schedule is inverted segment by segment, see fake_rtc_schedule_deadline.
+ * Trace is not inverted exactly: current offset is assumed to stay, and timer callbacks check time again
+ * Must be called inside rcu_read_lock, because schedule or trace of anchor may be used
+ * 
+ * @param anchor - synchronization point and mode
+ * @param fake_time - time from January 1st 1970
+ * @param now - current moment (by ktime_get)
+ * @return ktime_t - moment (by ktime_get) when fake time is not less than fake_time,
+ *                   not later than now if it is already reached
+ */
+static ktime_t fake_rtc_deadline(const struct fake_rtc_anchor *anchor, ktime_t fake_time, ktime_t now) {
+    const struct fake_rtc_schedule *schedule;
+    bool saturated;
+    s64 offset;
+    switch (anchor->mode) {
+    case SCHEDULE:
+        schedule = rcu_dereference(anchor->schedule);
+        return fake_rtc_schedule_deadline(anchor->synchronized_real_time, anchor->synchronized_boot_time,
+            schedule->segments, schedule->count, fake_time, now);
+    case TRACE:
+        offset = fake_rtc_trace_offset(&rcu_dereference(anchor->trace)->samples, now - anchor->synchronized_boot_time);
+        return fake_rtc_inverse_scale(fake_rtc_add_sat(anchor->synchronized_real_time, offset, &saturated),
+            anchor->synchronized_boot_time, fake_time, 1, 0);
+    default:
+        return fake_rtc_inverse_transform(anchor, fake_time);
+    }
+}
+
+/**
+ * @brief Move synchronization point to current moment without changing fake time
+ * 
+ * Must be called inside write section of anchor_lock of instance
+ */
+static void move_anchor_locked(struct fake_rtc_instance *instance) {
+    ktime_t now = ktime_get();
+    bool saturated;
+    rcu_read_lock();
+    instance->anchor.synchronized_real_time = fake_rtc_time_at(&instance->anchor, now, &saturated);
+    rcu_read_unlock();
+    instance->anchor.synchronized_boot_time = now;
+}
+
+/**
+ * @brief Prepare anchor for frequency correction
+ * 
+ * Synchronization point is moved to current moment, so corrections affect only time passed after them.
+ * Schedule and trace start at synchronization point and don't use corrected rate, so in their modes anchor stays
+ * Must be called inside write section of anchor_lock of instance
+ */
+static void rebase_locked(struct fake_rtc_instance *instance) {
+    if (!fake_rtc_mode_has_timeline(instance->anchor.mode)) {
+        move_anchor_locked(instance);
+    }
+}
+
+/**
+ * @brief Per-CPU generator of random coefficients
+ * 
+ * Generator is xoshiro128** from fake_rtc_transform.h, it is much cheaper than CRNG and gives reproducible streams.
+ * Values are generated in batches of RANDOM_BATCH_SIZE, so reading time usually takes one value from pool.
+ * Each CPU has its own stream seeded from random_seed and CPU number, so sequence of coefficients
+ * is reproduced exactly by a reader pinned to one CPU
+ * 
+ * @state - state of xoshiro128**
+ * @pool - batch of generated values
+ * @next - index of next unused value in pool
+ * @generation - value of fake_rtc_random_generation this generator was seeded at
+ */
+struct fake_rtc_random {
+    u32 state[4];
+    u32 pool[RANDOM_BATCH_SIZE];
+    unsigned int next;
+    int generation;
+};
+
+static DEFINE_PER_CPU(struct fake_rtc_random, fake_rtc_random);
+
+/**
+ * Seed of random mode. Changing seed increments generation, so every CPU reseeds its generator on next use
+ */
+static u64 fake_rtc_random_seed;
+static bool fake_rtc_random_seed_given;
+static atomic_t fake_rtc_random_generation = ATOMIC_INIT(1);
+
+static void random_reseed(struct fake_rtc_random *random, u64 seed, int cpu) {
+    fake_rtc_random_init(random->state, seed, cpu);
+    random->next = RANDOM_BATCH_SIZE;
+}
+
+static void random_refill(struct fake_rtc_random *random) {
+    unsigned int i;
+    for (i = 0; i < RANDOM_BATCH_SIZE; i++) {
+        random->pool[i] = fake_rtc_random_next(random->state);
+    }
+    random->next = 0;
+}
+
+/**
+ * @brief Get next random value of current CPU stream
+ * 
+ * @return u32 - random value
+ */
+static u32 random_next(void) {
+    struct fake_rtc_random *random = get_cpu_ptr(&fake_rtc_random);
+    int generation = atomic_read(&fake_rtc_random_generation);
+    u32 value;
+    if (unlikely(random->generation != generation)) {
+        smp_rmb();
+        random_reseed(random, READ_ONCE(fake_rtc_random_seed), smp_processor_id());
+        random->generation = generation;
+    }
+    if (unlikely(random->next == RANDOM_BATCH_SIZE)) {
+        random_refill(random);
+    }
+    value = random->pool[random->next++];
+    put_cpu_ptr(&fake_rtc_random);
+    return value;
+}
+
+static void set_random_seed(u64 seed) {
+    WRITE_ONCE(fake_rtc_random_seed, seed);
+    smp_wmb();
+    atomic_inc(&fake_rtc_random_generation);
+}
+
+/**
+ * @brief Replace rate of anchor copy with random coefficient
+ * 
+ * Coefficient is used as multiplier with zero shift, see fake_rtc_random_coefficient
+ * 
+ * @param anchor - copy of anchor to modify
+ */
+static void randomize_rate(struct fake_rtc_anchor *anchor) {
+    anchor->mult = fake_rtc_random_coefficient(random_next(), anchor->random_min, anchor->random_range);
+    anchor->shift = 0;
+}
+
+static int fake_rtc_seed_param_set(const char *val, const struct kernel_param *kp) {
+    u64 seed;
+    int status = kstrtou64(val, 0, &seed);
+    if (status) {
+        return status;
+    }
+    fake_rtc_random_seed_given = true;
+    set_random_seed(seed);
+    return 0;
+}
+
+static int fake_rtc_seed_param_get(char *buffer, const struct kernel_param *kp) {
+    return sprintf(buffer, "%llu\n", READ_ONCE(fake_rtc_random_seed));
+}
+
+static const struct kernel_param_ops fake_rtc_seed_param_ops = {
+    .set = fake_rtc_seed_param_set,
+    .get = fake_rtc_seed_param_get
+};
+
+module_param_cb(random_seed, &fake_rtc_seed_param_ops, NULL, 0644);
+MODULE_PARM_DESC(random_seed, "Seed of random mode. Writing it restarts random streams of all CPUs. Chosen randomly if not given");
+
+/**
+ * @brief Parse bounds of random coefficients
+ * 
+ * @param str - bounds in format "min:max", for example "-9:9"
+ * @param min - where to store smallest coefficient
+ * @param range - where to store number of coefficients
+ * @return int - status
+ */
+static int fake_rtc_parse_random_bounds(const char *str, s32 *min, u64 *range) {
+    s32 max;
+    if (sscanf(str, "%d:%d", min, &max) != 2 || *min > max) {
+        return -EINVAL;
+    }
+    *range = (s64)max - *min + 1;
+    return 0;
+}
+
+/**
+ * @brief set function for random_bounds module parameter
+ * 
+ * Like rates, bounds are applied to default instance and become initial bounds of new instances
+ */
+static int fake_rtc_bounds_param_set(const char *val, const struct kernel_param *kp) {
+    struct fake_rtc_instance *instance = fake_rtc_default;
+    s32 min;
+    u64 range;
+    int status = fake_rtc_parse_random_bounds(val, &min, &range);
+    if (status) {
+        return status;
+    }
+    mutex_lock(&fake_rtc_instances_mutex);
+    fake_rtc_random_min = min;
+    fake_rtc_random_range = range;
+    mutex_unlock(&fake_rtc_instances_mutex);
+    if (instance == NULL) {
+        return 0;
+    }
+    anchor_write_begin(instance);
+    instance->anchor.random_min = min;
+    instance->anchor.random_range = range;
+    anchor_write_end(instance);
+    return 0;
+}
+
+static int fake_rtc_bounds_param_get(char *buffer, const struct kernel_param *kp) {
+    struct fake_rtc_instance *instance = fake_rtc_default;
+    struct fake_rtc_anchor anchor = {
+        .random_min = fake_rtc_random_min,
+        .random_range = fake_rtc_random_range
+    };
+    if (instance != NULL) {
+        fake_rtc_read_anchor(instance, &anchor);
+    }
+    return sprintf(buffer, "%d:%lld\n", anchor.random_min, anchor.random_min + (s64)anchor.random_range - 1);
+}
+
+static const struct kernel_param_ops fake_rtc_bounds_param_ops = {
+    .set = fake_rtc_bounds_param_set,
+    .get = fake_rtc_bounds_param_get
+};
+
+module_param_cb(random_bounds, &fake_rtc_bounds_param_ops, NULL, 0644);
+MODULE_PARM_DESC(random_bounds, "Bounds of random mode coefficients in format \"min:max\", \"-9:9\" by default");
+
+/**
+ * @brief One period of sine in Q15 format, used for wander of oscillator
+ */
+static const s16 fake_rtc_sine[64] = {
+    0, 3212, 6393, 9512, 12539, 15446, 18204, 20787,
+    23170, 25329, 27245, 28898, 30273, 31356, 32137, 32609,
+    32767, 32609, 32137, 31356, 30273, 28898, 27245, 25329,
+    23170, 20787, 18204, 15446, 12539, 9512, 6393, 3212,
+    0, -3212, -6393, -9512, -12539, -15446, -18204, -20787,
+    -23170, -25329, -27245, -28898, -30273, -31356, -32137, -32609,
+    -32767, -32609, -32137, -31356, -30273, -28898, -27245, -25329,
+    -23170, -20787, -18204, -15446, -12539, -9512, -6393, -3212
+};
+
+/**
+ * @brief Random integer from -bound to bound, taken from the same per-CPU generator as random mode
+ * 
+ * @param bound - largest absolute value of result
+ * @return s64 - random value
+ */
+static s64 random_symmetric(u32 bound) {
+    return (s64)(((u64)random_next() * (2 * (u64)bound + 1)) >> 32) - bound;
+}
+
+/**
+ * @brief Check if oscillator model needs periodic updates
+ * 
+ * @param instance - instance of fake clock
+ * @return bool - true if wander or random walk is enabled
+ */
+static bool oscillator_is_dynamic(struct fake_rtc_instance *instance) {
+    const struct fake_rtc_oscillator *oscillator = &instance->oscillator;
+    return oscillator->wander_ppb != 0 || oscillator->walk_step_ppb != 0;
+}
+
+/**
+ * @brief Calculate frequency error of oscillator model at given fake time
+ * 
+ * Wander is interpolated linearly between points of sine table.
+ * Must be called inside write section of anchor_lock of instance
+ * 
+ * @param instance - instance of fake clock
+ * @param fake_now - current fake time
+ * @param step - make step of random walk
+ * @return s64 - frequency error in parts per billion
+ */
+static s64 oscillator_drift_locked(struct fake_rtc_instance *instance, ktime_t fake_now, bool step) {
+    struct fake_rtc_oscillator *oscillator = &instance->oscillator;
+    s64 drift = oscillator->skew_ppb;
+    if (oscillator->wander_ppb != 0) {
+        u64 position;
+        u64 index;
+        u64 fraction;
+        s32 first;
+        s32 second;
+        div64_u64_rem(fake_now, oscillator->wander_period, &position);
+        /* Index in sine table with 16 fractional bits, 2^22 per period */
+        if (oscillator->wander_period >> 42 == 0) {
+            index = div64_u64(position << 22, oscillator->wander_period);
+        } else {
+            index = min_t(u64, div64_u64(position, oscillator->wander_period >> 22), (1 << 22) - 1);
+        }
+        fraction = index & 0xffff;
+        index >>= 16;
+        first = fake_rtc_sine[index];
+        second = fake_rtc_sine[(index + 1) % ARRAY_SIZE(fake_rtc_sine)];
+        drift += ((s64)oscillator->wander_ppb * (first * 65536 + (second - first) * (s64)fraction)) >> 31;
+    }
+    if (step && oscillator->walk_step_ppb != 0) {
+        s64 walk = oscillator->walk_ppb + random_symmetric(oscillator->walk_step_ppb);
+        oscillator->walk_ppb = clamp_t(s64, walk, -oscillator->walk_limit_ppb, oscillator->walk_limit_ppb);
+    }
+    return drift + oscillator->walk_ppb;
+}
+
+/**
+ * @brief Fold current frequency error of oscillator model into multiplier
+ * 
+ * Synchronization point is moved first, so new error affects only time passed after it.
+ * Must be called inside write section of anchor_lock of instance
+ * 
+ * @param instance - instance of fake clock
+ * @param step - make step of random walk
+ */
+static void oscillator_update_locked(struct fake_rtc_instance *instance, bool step) {
+    if (!fake_rtc_mode_is_linear(instance->anchor.mode)) {
+        return;
+    }
+    rebase_locked(instance);
+    instance->drift_ppb = oscillator_drift_locked(instance, instance->anchor.synchronized_real_time, step);
+    update_transform_locked(instance);
+}
+
+/**
+ * @brief Periodic update of oscillator model
+ * 
+ * Work stops rescheduling itself when wander and random walk are disabled
+ * 
+ * @param work 
+ */
+static void oscillator_work_fn(struct work_struct *work) {
+    struct fake_rtc_instance *instance = container_of(to_delayed_work(work), struct fake_rtc_instance, oscillator_work);
+    bool dynamic;
+    anchor_write_begin(instance);
+    oscillator_update_locked(instance, true);
+    dynamic = oscillator_is_dynamic(instance);
+    anchor_write_end(instance);
+    if (dynamic) {
+        schedule_delayed_work(&instance->oscillator_work, msecs_to_jiffies(OSCILLATOR_UPDATE_MS));
+    }
+}
+
+/**
+ * @brief Fake time at given moment with random coefficient and jitter applied
+ * 
+ * Must be called inside rcu_read_lock, like fake_rtc_time_at
+ * 
+ * @param instance - instance of fake clock
+ * @param anchor - snapshot of anchor. In random mode its coefficient is replaced by new one
+ * @param now - moment (by ktime_get) not before synchronization
+ * @param counted - true if time is read at current moment, so it is counted and traced as one read.
+ *                  Predicted times of future moments are not
+ * @return ktime_t - time from January 1st 1970
+ */
+static ktime_t fake_rtc_sample_at(struct fake_rtc_instance *instance, struct fake_rtc_anchor *anchor, ktime_t now, bool counted) {
+    ktime_t my_time;
+    bool saturated;
+    if (anchor->mode == RANDOM) {
+        randomize_rate(anchor);
+    }
+    my_time = fake_rtc_time_at(anchor, now, &saturated);
+    if (anchor->jitter != 0 && !saturated) {
+        my_time = fake_rtc_add_sat(my_time, random_symmetric(anchor->jitter), &saturated);
+    }
+    if (!counted) {
+        return my_time;
+    }
+    if (saturated) {
+        this_cpu_inc(instance->counters->saturated);
+    }
+    this_cpu_inc(instance->counters->read);
+    trace_fake_rtc_read(now, my_time, anchor->mode, saturated);
+    return my_time;
+}
+
+/**
+ * @brief Get current fake time
+ * 
+ * This function calculates nanoseconds spent from last synchronization and use it to get time value based on mode
+ * Synchronization point, mode and rate are taken as one consistent snapshot, see fake_rtc_read_anchor
+ * 
+ * @param instance - instance of fake clock
+ * @param anchor - where to store snapshot of anchor used for calculation. Its schedule must not be used after return
+ * @return ktime_t - time from January 1st 1970
+ */
+static ktime_t fake_rtc_get_time(struct fake_rtc_instance *instance, struct fake_rtc_anchor *anchor) {
+    ktime_t my_time;
+    rcu_read_lock();
+    fake_rtc_read_anchor(instance, anchor);
+    my_time = fake_rtc_sample_at(instance, anchor, ktime_get(), true);
+    rcu_read_unlock();
+    return my_time;
+}
+
+/**
+ * @brief read time function, part of rtc interface
+ * 
+ * Because fake_rtc_get_time returns nanoseconds from January 1st 1970, this function converts it to rtc_time.
+ * Tasks of pid namespace bound to configfs instance read time of that instance, see fake_rtc_view
+ * 
+ * @param dev 
+ * @param tm 
+ * @return int - status
+ */
+static int fake_rtc_read_time(struct device * dev, struct rtc_time * tm) {
+    struct fake_rtc_anchor anchor;
+    u64 start = fake_rtc_stats_start();
+    ktime_t my_time;
+    rcu_read_lock();
+    my_time = fake_rtc_get_time(fake_rtc_view(dev_get_drvdata(dev)), &anchor);
+    rcu_read_unlock();
+    rtc_time64_to_tm(my_time / NANOSECONDS_IN_SECOND, tm);
+    fake_rtc_stats_read(start, anchor.mode);
+    return 0;
+}
+
+/**
+ * @brief set time function, part of rtc interface
+ * 
+ * Like read, sets time of instance bound to pid namespace of current task
+ * 
+ * @param dev 
+ * @param tm 
+ * @return int - status
+ */
+static int fake_rtc_set_time(struct device * dev, struct rtc_time * tm) {
+    struct fake_rtc_instance *instance;
+    u64 start = fake_rtc_stats_start();
+    rcu_read_lock();
+    instance = fake_rtc_view(dev_get_drvdata(dev));
+    synchronize_time(instance, rtc_tm_to_ktime(*tm));
+    this_cpu_inc(instance->counters->set);
+    rcu_read_unlock();
+    fake_rtc_stats_set(start);
+    return 0;
+}
+
+/**
+ * @brief Arm alarm timer for current alarm time
+ * 
+ * Fake alarm time is converted to real moment using current mode, see fake_rtc_deadline
+ */
+static void start_alarm_timer(struct fake_rtc_instance *instance) {
+    struct fake_rtc_anchor anchor;
+    ktime_t deadline;
+    rcu_read_lock();
+    fake_rtc_read_anchor(instance, &anchor);
+    deadline = fake_rtc_deadline(&anchor, READ_ONCE(instance->alarm_time), ktime_get());
+    rcu_read_unlock();
+    hrtimer_start(&instance->alarm_timer, deadline, HRTIMER_MODE_ABS);
+}
+
+/**
+ * @brief Rearm alarm timer after change of mode, rate or time
+ * 
+ * Timer is not cancelled: hrtimer_start moves it to new moment. If alarm is disabled concurrently,
+ * timer callback just returns
+ */
+static void rearm_alarm_timer(struct fake_rtc_instance *instance) {
+    if (READ_ONCE(instance->alarm_enabled)) {
+        start_alarm_timer(instance);
+    }
+}
+
+/**
+ * @brief Callback of alarm timer
+ * 
+ * Fake time is checked again, because it could be changed after timer was armed.
+ * If it has not reached alarm time yet, timer is rearmed, otherwise RTC core is notified.
+ * RTC core emulates update interrupts (UIE) with alarm at the next fake second,
+ * so this is what wakes up hwclock waiting for the seconds tick
+ * 
+ * @param timer 
+ * @return enum hrtimer_restart 
+ */
+static enum hrtimer_restart fake_rtc_alarm_fire(struct hrtimer *timer) {
+    struct fake_rtc_instance *instance = container_of(timer, struct fake_rtc_instance, alarm_timer);
+    struct fake_rtc_anchor anchor;
+    ktime_t alarm_time = READ_ONCE(instance->alarm_time);
+    ktime_t now = ktime_get();
+    bool saturated;
+    if (!READ_ONCE(instance->alarm_enabled)) {
+        return HRTIMER_NORESTART;
+    }
+    rcu_read_lock();
+    fake_rtc_read_anchor(instance, &anchor);
+    if (fake_rtc_time_at(&anchor, now, &saturated) < alarm_time) {
+        hrtimer_set_expires(timer, max(fake_rtc_deadline(&anchor, alarm_time, now), now + 1));
+        rcu_read_unlock();
+        return HRTIMER_RESTART;
+    }
+    rcu_read_unlock();
+    rtc_update_irq(instance->rtc_dev, 1, RTC_AF | RTC_IRQF);
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * @brief read alarm function, part of rtc interface
+ * 
+ * Alarm is not available to tasks of pid namespaces bound to another instance, see fake_rtc_view_is_bound
+ * 
+ * @param dev 
+ * @param alarm 
+ * @return int - status
+ */
+static int fake_rtc_read_alarm(struct device * dev, struct rtc_wkalrm * alarm) {
+    struct fake_rtc_instance *instance = dev_get_drvdata(dev);
+    struct fake_rtc_anchor anchor;
+    ktime_t alarm_time = READ_ONCE(instance->alarm_time);
+    bool saturated;
+    if (fake_rtc_view_is_bound(instance)) {
+        return -EINVAL;
+    }
+    alarm->time = rtc_ktime_to_tm(alarm_time);
+    alarm->enabled = READ_ONCE(instance->alarm_enabled);
+    rcu_read_lock();
+    fake_rtc_read_anchor(instance, &anchor);
+    alarm->pending = alarm->enabled && fake_rtc_time_at(&anchor, ktime_get(), &saturated) >= alarm_time;
+    rcu_read_unlock();
+    return 0;
+}
+
+/**
+ * @brief set alarm function, part of rtc interface
+ * 
+ * Alarm is set in fake time: real moment of alarm is found by inverting transform of current mode,
+ * and it is recalculated every time mode, rate or time changes, see rearm_alarm_timer.
+ * RTC core serializes calls with its ops_lock.
+ * Tasks of pid namespaces bound to another instance get -EINVAL. This is only a partial guard:
+ * RTC core calls this function only when new timer becomes the first in its queue, and its work
+ * programming later timers runs in init pid namespace, so such timers follow time of this instance
+ * 
+ * @param dev 
+ * @param alarm 
+ * @return int - status
+ */
+static int fake_rtc_set_alarm(struct device * dev, struct rtc_wkalrm * alarm) {
+    struct fake_rtc_instance *instance = dev_get_drvdata(dev);
+    if (fake_rtc_view_is_bound(instance)) {
+        return -EINVAL;
+    }
+    WRITE_ONCE(instance->alarm_enabled, false);
+    hrtimer_cancel(&instance->alarm_timer);
+    WRITE_ONCE(instance->alarm_time, rtc_tm_to_ktime(alarm->time));
+    WRITE_ONCE(instance->alarm_enabled, alarm->enabled);
+    rearm_alarm_timer(instance);
+    return 0;
+}
+
+/**
+ * @brief alarm irq enable function, part of rtc interface
+ * 
+ * Like fake_rtc_set_alarm, alarm can't be enabled by tasks of pid namespaces bound to another instance.
+ * Disabling follows timer queue of RTC core, so it is allowed to everyone
+ * 
+ * @param dev 
+ * @param enabled 
+ * @return int - status
+ */
+static int fake_rtc_alarm_irq_enable(struct device * dev, unsigned int enabled) {
+    struct fake_rtc_instance *instance = dev_get_drvdata(dev);
+    if (enabled && fake_rtc_view_is_bound(instance)) {
+        return -EINVAL;
+    }
+    WRITE_ONCE(instance->alarm_enabled, false);
+    hrtimer_cancel(&instance->alarm_timer);
+    WRITE_ONCE(instance->alarm_enabled, enabled);
+    rearm_alarm_timer(instance);
+    return 0;
+}
+
+/**
+ * @brief read offset function, part of rtc interface
+ * 
+ * Like read of time, reads trim of instance bound to pid namespace of current task
+ * 
+ * @param dev 
+ * @param offset - frequency trim in parts per billion
+ * @return int - status
+ */
+static int fake_rtc_read_offset(struct device * dev, long * offset) {
+    struct fake_rtc_instance *instance;
+    unsigned int sequence;
+    rcu_read_lock();
+    instance = fake_rtc_view(dev_get_drvdata(dev));
+    do {
+        sequence = read_seqbegin(&instance->anchor_lock);
+        *offset = instance->offset_ppb;
+    } while (read_seqretry(&instance->anchor_lock, sequence));
+    rcu_read_unlock();
+    return 0;
+}
+
+/**
+ * @brief set offset function, part of rtc interface
+ * 
+ * As described in sysfs-class-rtc ABI, positive offset makes clock slower. Trim is folded into multiplier
+ * together with PTP correction and oscillator drift, and affects only time passed after it.
+ * Like set of time, changes trim of instance bound to pid namespace of current task
+ * 
+ * @param dev 
+ * @param offset - frequency trim in parts per billion
+ * @return int - status
+ */
+static int fake_rtc_set_offset(struct device * dev, long offset) {
+    struct fake_rtc_instance *instance;
+    if (offset < -MAX_CORRECTION_PPB || offset > MAX_CORRECTION_PPB) {
+        return -ERANGE;
+    }
+    rcu_read_lock();
+    instance = fake_rtc_view(dev_get_drvdata(dev));
+    anchor_write_begin(instance);
+    rebase_locked(instance);
+    instance->offset_ppb = offset;
+    update_transform_locked(instance);
+    anchor_write_end(instance);
+    rcu_read_unlock();
+    return 0;
+}
+
+static const struct rtc_class_ops fake_rtc_operations = {
+    .read_time = fake_rtc_read_time,
+    .set_time = fake_rtc_set_time,
+    .read_alarm = fake_rtc_read_alarm,
+    .set_alarm = fake_rtc_set_alarm,
+    .alarm_irq_enable = fake_rtc_alarm_irq_enable,
+    .read_offset = fake_rtc_read_offset,
+    .set_offset = fake_rtc_set_offset
+};
+
+/**
+ * @brief gettime64 function, part of PTP clock interface
+ * 
+ * Gives fake time with nanosecond resolution, without calendar conversion and RTC core locking
+ * 
+ * @param ptp 
+ * @param ts 
+ * @return int - status
+ */
+static int fake_rtc_ptp_gettime(struct ptp_clock_info *ptp, struct timespec64 *ts) {
+    struct fake_rtc_instance *instance = container_of(ptp, struct fake_rtc_instance, ptp_info);
+    struct fake_rtc_anchor anchor;
+    *ts = ktime_to_timespec64(fake_rtc_get_time(instance, &anchor));
+    return 0;
+}
+
+static int fake_rtc_ptp_settime(struct ptp_clock_info *ptp, const struct timespec64 *ts) {
+    struct fake_rtc_instance *instance = container_of(ptp, struct fake_rtc_instance, ptp_info);
+    if (ts->tv_sec < MIN_FAKE_TIME / NANOSECONDS_IN_SECOND) {
+        return -ERANGE;
+    }
+    synchronize_time(instance, timespec64_to_ktime(*ts));
+    this_cpu_inc(instance->counters->set);
+    return 0;
+}
+
+/**
+ * @brief adjtime function, part of PTP clock interface
+ * 
+ * Shifting synchronized real time shifts fake time by the same value in any mode
+ * 
+ * @param ptp 
+ * @param delta - nanoseconds to add to fake time
+ * @return int - status
+ */
+static int fake_rtc_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta) {
+    struct fake_rtc_instance *instance = container_of(ptp, struct fake_rtc_instance, ptp_info);
+    anchor_write_begin(instance);
+    shift_time_locked(instance, delta);
+    anchor_write_end(instance);
+    return 0;
+}
+
+/**
+ * @brief adjfine function, part of PTP clock interface
+ * 
+ * Frequency correction is applied on top of rate of every mode
+ * 
+ * @param ptp 
+ * @param scaled_ppm - correction in parts per million with 16 bit fractional part
+ * @return int - status
+ */
+static int fake_rtc_ptp_adjfine(struct ptp_clock_info *ptp, long scaled_ppm) {
+    struct fake_rtc_instance *instance = container_of(ptp, struct fake_rtc_instance, ptp_info);
+    anchor_write_begin(instance);
+    rebase_locked(instance);
+    instance->correction_ppb = scaled_ppm_to_ppb(scaled_ppm);
+    update_transform_locked(instance);
+    anchor_write_end(instance);
+    return 0;
+}
+
+static int fake_rtc_ptp_enable(struct ptp_clock_info *ptp, struct ptp_clock_request *request, int on) {
+    return -EOPNOTSUPP;
+}
+
+/**
+ * @brief Template of PTP clock description, copied to every instance which registers PTP clock
+ */
+static const struct ptp_clock_info fake_rtc_ptp_info = {
+    .owner = THIS_MODULE,
+    .name = DEVICE_NAME,
+    .max_adj = MAX_CORRECTION_PPB,
+    .adjfine = fake_rtc_ptp_adjfine,
+    .adjtime = fake_rtc_ptp_adjtime,
+    .gettime64 = fake_rtc_ptp_gettime,
+    .settime64 = fake_rtc_ptp_settime,
+    .enable = fake_rtc_ptp_enable
+};
+
+/**
+ * @brief Private timeline of one open of /dev/fake_rtc, see FAKE_RTC_SET_TIMELINE
+ * 
+ * @enabled - reads of this open return time of timeline instead of fake time of device
+ * @start - time of timeline at anchor
+ * @base_time - fake time of device at anchor
+ * @mult - fixed point rate of timeline relative to device
+ * @shift - number of fractional bits in mult
+ * @inverse_mult - fixed point value of 1 / rate, used by FAKE_RTC_EVALUATE_INVERSE
+ * @inverse_shift - number of fractional bits in inverse_mult
+ */
+struct fake_rtc_file_timeline {
+    bool enabled;
+    ktime_t start;
+    ktime_t base_time;
+    s64 mult;
+    u32 shift;
+    s64 inverse_mult;
+    u32 inverse_shift;
+};
+
+/**
+ * @brief State of one open of /dev/fake_rtc
+ * 
+ * Every open has its own periodic interrupt with RTC-compatible interface: RTC_IRQP_SET, RTC_PIE_ON and read()
+ * Frequency is set in fake time, so real frequency of interrupts is scaled by rate of current mode.
+ * Open may also have private timeline, which is used by FAKE_RTC_GET_TIME. Periodic interrupts follow fake time
+ * of device
+ * 
+ * @lock - protects pie_pending and pie_missed, taken in timer callback
+ * @pie_timer - timer firing on periodic interrupts
+ * @pie_wait - readers waiting for periodic interrupt
+ * @pie_freq - frequency of periodic interrupt in fake Hz
+ * @pie_next - fake time of next periodic interrupt
+ * @pie_pending - number of periodic interrupts not read yet
+ * @pie_missed - number of periodic interrupts coalesced with other ones because reader was late
+ * @pie_enabled - periodic interrupt is on. Changed only in ioctl, which is serialized by pie_mutex
+ * @pie_mutex - serializes ioctl commands changing periodic interrupt
+ * @instance - instance this file reads time of
+ * @timeline_lock - protects timeline, so reads of this open take no lock shared with other opens
+ * @timeline - private timeline of this open
+ */
+struct fake_rtc_file {
+    spinlock_t lock;
+    struct hrtimer pie_timer;
+    wait_queue_head_t pie_wait;
+    unsigned long pie_freq;
+    ktime_t pie_next;
+    unsigned long pie_pending;
+    u64 pie_missed;
+    bool pie_enabled;
+    struct mutex pie_mutex;
+    struct fake_rtc_instance *instance;
+    seqlock_t timeline_lock;
+    struct fake_rtc_file_timeline timeline;
+};
+
+/**
+ * @brief Callback of periodic interrupt timer
+ * 
+ * Interrupts are counted in fake time: all periods passed since previous callback are reported at once,
+ * so reader gets correct count even if timer was late or rate is too high for real timer.
+ * Period of real timer is recalculated every time, so it follows changes of mode and rate
+ * 
+ * @param timer 
+ * @return enum hrtimer_restart 
+ */
+static enum hrtimer_restart fake_rtc_pie_fire(struct hrtimer *timer) {
+    struct fake_rtc_file *state = container_of(timer, struct fake_rtc_file, pie_timer);
+    struct fake_rtc_anchor anchor;
+    ktime_t now = ktime_get();
+    ktime_t fake_now;
+    u64 period = div_u64(NSEC_PER_SEC, state->pie_freq);
+    u64 ticks;
+    unsigned long flags;
+    bool saturated;
+    rcu_read_lock();
+    fake_rtc_read_anchor(state->instance, &anchor);
+    fake_now = fake_rtc_time_at(&anchor, now, &saturated);
+    if (saturated) {
+        /* Fake time stopped at range limit, so there will be no more periods */
+        rcu_read_unlock();
+        return HRTIMER_NORESTART;
+    }
+    ticks = fake_rtc_periodic_ticks(&state->pie_next, fake_now, period);
+    if (ticks != 0) {
+        spin_lock_irqsave(&state->lock, flags);
+        state->pie_pending += ticks;
+        spin_unlock_irqrestore(&state->lock, flags);
+        wake_up_interruptible(&state->pie_wait);
+    }
+    hrtimer_set_expires(timer, max(fake_rtc_deadline(&anchor, state->pie_next, now), now + MIN_PIE_PERIOD_NS));
+    rcu_read_unlock();
+    return HRTIMER_RESTART;
+}
+
+static void fake_rtc_pie_start(struct fake_rtc_file *state) {
+    struct fake_rtc_anchor anchor;
+    ktime_t now = ktime_get();
+    ktime_t deadline;
+    bool saturated;
+    rcu_read_lock();
+    fake_rtc_read_anchor(state->instance, &anchor);
+    state->pie_next = fake_rtc_time_at(&anchor, now, &saturated) + div_u64(NSEC_PER_SEC, state->pie_freq);
+    deadline = fake_rtc_deadline(&anchor, state->pie_next, now);
+    rcu_read_unlock();
+    hrtimer_start(&state->pie_timer, deadline, HRTIMER_MODE_ABS);
+}
+
+/**
+ * @brief Handle ioctl commands of periodic interrupt
+ * 
+ * @param state - state of this open
+ * @param cmd - RTC_IRQP_SET, RTC_PIE_ON or RTC_PIE_OFF
+ * @param arg - frequency for RTC_IRQP_SET
+ * @return long - status
+ */
+static long fake_rtc_pie_ioctl(struct fake_rtc_file *state, unsigned int cmd, unsigned long arg) {
+    long status = 0;
+    mutex_lock(&state->pie_mutex);
+    switch (cmd) {
+    case RTC_IRQP_SET:
+        if (arg == 0 || arg > MAX_PIE_FREQ) {
+            status = -EINVAL;
+            break;
+        }
+        hrtimer_cancel(&state->pie_timer);
+        state->pie_freq = arg;
+        if (state->pie_enabled) {
+            fake_rtc_pie_start(state);
+        }
+        break;
+    case RTC_PIE_ON:
+        if (!state->pie_enabled) {
+            state->pie_enabled = true;
+            fake_rtc_pie_start(state);
+        }
+        break;
+    case RTC_PIE_OFF:
+        state->pie_enabled = false;
+        hrtimer_cancel(&state->pie_timer);
+        break;
+    }
+    mutex_unlock(&state->pie_mutex);
+    return status;
+}
+
+/**
+ * @brief open function for /dev/fake_rtc
+ * 
+ * File is attached to instance bound to pid namespace of opening task, so time, page and periodic interrupts
+ * of this file come from that instance. File holds reference to configfs instance until release
+ * 
+ * @param inode 
+ * @param file 
+ * @return int - status, -ENODEV if bound instance is being removed
+ */
+static int fake_rtc_dev_open(struct inode *inode, struct file *file) {
+    struct fake_rtc_file *state;
+    struct fake_rtc_instance *instance;
+    rcu_read_lock();
+    instance = fake_rtc_view(fake_rtc_default);
+    if (instance != fake_rtc_default && !fake_rtc_instance_get(instance)) {
+        instance = NULL;
+    }
+    rcu_read_unlock();
+    if (instance == NULL) {
+        return -ENODEV;
+    }
+    state = kzalloc(sizeof(*state), GFP_KERNEL);
+    if (state == NULL) {
+        if (instance != fake_rtc_default) {
+            fake_rtc_instance_put(instance);
+        }
+        return -ENOMEM;
+    }
+    spin_lock_init(&state->lock);
+    mutex_init(&state->pie_mutex);
+    init_waitqueue_head(&state->pie_wait);
+    hrtimer_init(&state->pie_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    state->pie_timer.function = fake_rtc_pie_fire;
+    state->pie_freq = DEFAULT_PIE_FREQ;
+    state->instance = instance;
+    seqlock_init(&state->timeline_lock);
+    file->private_data = state;
+    return 0;
+}
+
+static int fake_rtc_dev_release(struct inode *inode, struct file *file) {
+    struct fake_rtc_file *state = file->private_data;
+    hrtimer_cancel(&state->pie_timer);
+    if (state->instance != fake_rtc_default) {
+        fake_rtc_instance_put(state->instance);
+    }
+    kfree(state);
+    return 0;
+}
+
+/**
+ * @brief read function for /dev/fake_rtc
+ * 
+ * Works like read of /dev/rtcN: waits for periodic interrupt and returns number of interrupts
+ * since previous read in high bytes and RTC_PF | RTC_IRQF in low byte
+ * 
+ * @param file 
+ * @param buffer 
+ * @param count - sizeof(unsigned int) or sizeof(unsigned long)
+ * @param offset 
+ * @return ssize_t - number of bytes read
+ */
+static ssize_t fake_rtc_dev_read(struct file *file, char __user *buffer, size_t count, loff_t *offset) {
+    struct fake_rtc_file *state = file->private_data;
+    unsigned long data;
+    int status;
+    if (count != sizeof(unsigned int) && count < sizeof(unsigned long)) {
+        return -EINVAL;
+    }
+    spin_lock_irq(&state->lock);
+    while (state->pie_pending == 0) {
+        spin_unlock_irq(&state->lock);
+        if (file->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        status = wait_event_interruptible(state->pie_wait, READ_ONCE(state->pie_pending) != 0);
+        if (status) {
+            return status;
+        }
+        spin_lock_irq(&state->lock);
+    }
+    data = (state->pie_pending << 8) | RTC_PF | RTC_IRQF;
+    state->pie_missed += state->pie_pending - 1;
+    this_cpu_add(state->instance->counters->pie_missed, state->pie_pending - 1);
+    state->pie_pending = 0;
+    spin_unlock_irq(&state->lock);
+    if (count == sizeof(unsigned int)) {
+        status = put_user((unsigned int)data, (unsigned int __user *)buffer);
+        return status ? status : sizeof(unsigned int);
+    }
+    status = put_user(data, (unsigned long __user *)buffer);
+    return status ? status : sizeof(unsigned long);
+}
+
+static __poll_t fake_rtc_dev_poll(struct file *file, poll_table *wait) {
+    struct fake_rtc_file *state = file->private_data;
+    poll_wait(file, &state->pie_wait, wait);
+    return READ_ONCE(state->pie_pending) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+/**
+ * @brief mmap function for /dev/fake_rtc
+ * 
+ * Maps read-only page with current anchor, see struct fake_rtc_page.
+ * Mapping holds reference to the page, so it stays valid after configfs instance is removed
+ * 
+ * @param file 
+ * @param vma 
+ * @return int - status
+ */
+static int fake_rtc_dev_mmap(struct file *file, struct vm_area_struct *vma) {
+    struct fake_rtc_file *state = file->private_data;
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE) {
+        return -EINVAL;
+    }
+    if (vma->vm_flags & VM_WRITE) {
+        return -EPERM;
+    }
+    vma->vm_flags &= ~VM_MAYWRITE;
+    return vm_insert_page(vma, vma->vm_start, virt_to_page(state->instance->page));
+}
+
+/**
+ * @brief Get consistent copy of private timeline of open
+ * 
+ * @param state - state of open
+ * @param timeline - where to store the copy
+ */
+static void fake_rtc_file_read_timeline(struct fake_rtc_file *state, struct fake_rtc_file_timeline *timeline) {
+    unsigned int sequence;
+    do {
+        sequence = read_seqbegin(&state->timeline_lock);
+        *timeline = state->timeline;
+    } while (read_seqretry(&state->timeline_lock, sequence));
+}
+
+/**
+ * @brief Convert fake time of device to time of private timeline
+ * 
+ * @param timeline - copy of private timeline
+ * @param device_time - fake time of device
+ * @return ktime_t - time of timeline if it is enabled, device_time otherwise
+ */
+static ktime_t fake_rtc_file_timeline_time(const struct fake_rtc_file_timeline *timeline, ktime_t device_time) {
+    bool saturated;
+    if (!timeline->enabled) {
+        return device_time;
+    }
+    return fake_rtc_timeline_time(timeline->start, timeline->base_time, device_time, timeline->mult, timeline->shift,
+        &saturated);
+}
+
+/**
+ * @brief Convert time of private timeline to fake time of device
+ * 
+ * @param timeline - copy of private timeline
+ * @param time - time of timeline
+ * @return ktime_t - fake time of device if timeline is enabled, time otherwise
+ */
+static ktime_t fake_rtc_file_timeline_inverse(const struct fake_rtc_file_timeline *timeline, ktime_t time) {
+    bool saturated;
+    if (!timeline->enabled) {
+        return time;
+    }
+    return fake_rtc_timeline_time(timeline->base_time, timeline->start, time, timeline->inverse_mult,
+        timeline->inverse_shift, &saturated);
+}
+
+/**
+ * @brief Fake time seen by one open of /dev/fake_rtc
+ * 
+ * @param state - state of open
+ * @param anchor - where to store anchor of device used for calculation
+ * @return ktime_t - time of private timeline if it is set, fake time of device otherwise
+ */
+static ktime_t fake_rtc_file_get_time(struct fake_rtc_file *state, struct fake_rtc_anchor *anchor) {
+    ktime_t device_time = fake_rtc_get_time(state->instance, anchor);
+    struct fake_rtc_file_timeline timeline;
+    fake_rtc_file_read_timeline(state, &timeline);
+    return fake_rtc_file_timeline_time(&timeline, device_time);
+}
+
+/**
+ * @brief Set private timeline of open, anchored at current fake time of device
+ * 
+ * @param state - state of open
+ * @param argument - userspace struct fake_rtc_timeline, base_time is written back
+ * @return long - status
+ */
+static long fake_rtc_set_timeline(struct fake_rtc_file *state, struct fake_rtc_timeline __user *argument) {
+    struct fake_rtc_timeline request;
+    struct fake_rtc_file_timeline timeline = { .enabled = true };
+    struct fake_rtc_anchor anchor;
+    bool saturated;
+    if (copy_from_user(&request, argument, sizeof(request))) {
+        return -EFAULT;
+    }
+    if (request.num == 0 || request.den == 0) {
+        return -EINVAL;
+    }
+    fake_rtc_rate_to_fixed(request.num, request.den, &timeline.mult, &timeline.shift);
+    fake_rtc_rate_to_fixed(request.den, request.num, &timeline.inverse_mult, &timeline.inverse_shift);
+    timeline.base_time = fake_rtc_get_time(state->instance, &anchor);
+    timeline.start = fake_rtc_add_sat(timeline.base_time, request.offset, &saturated);
+    write_seqlock(&state->timeline_lock);
+    state->timeline = timeline;
+    write_sequnlock(&state->timeline_lock);
+    request.base_time = timeline.base_time;
+    return copy_to_user(argument, &request, sizeof(request)) ? -EFAULT : 0;
+}
+
+/**
+ * @brief Fill user buffer with samples of fake time of open, see struct fake_rtc_sample_request
+ * 
+ * Anchor is read once, so the whole batch costs one seqlock read and one copy_to_user.
+ * Only samples taken at current moment are counted and traced as reads, predicted ones are not
+ * 
+ * @param state - state of open
+ * @param argument - userspace struct fake_rtc_sample_request
+ * @return long - status
+ */
+static long fake_rtc_sample(struct fake_rtc_file *state, const struct fake_rtc_sample_request __user *argument) {
+    struct fake_rtc_sample_request request;
+    struct fake_rtc_file_timeline timeline;
+    struct fake_rtc_anchor anchor;
+    struct fake_rtc_sample *samples;
+    ktime_t now;
+    u32 i;
+    long status = 0;
+    if (copy_from_user(&request, argument, sizeof(request))) {
+        return -EFAULT;
+    }
+    if (request.count == 0 || request.count > FAKE_RTC_MAX_SAMPLES || request.flags != 0 || request.spacing < 0 ||
+            request.spacing > MAX_SAMPLE_SPAN / request.count) {
+        return -EINVAL;
+    }
+    samples = kvmalloc_array(request.count, sizeof(*samples), GFP_KERNEL);
+    if (samples == NULL) {
+        return -ENOMEM;
+    }
+    fake_rtc_file_read_timeline(state, &timeline);
+    rcu_read_lock();
+    fake_rtc_read_anchor(state->instance, &anchor);
+    now = ktime_get();
+    for (i = 0; i < request.count; i++) {
+        if (request.spacing == 0) {
+            now = ktime_get();
+        } else if (i != 0) {
+            now += request.spacing;
+        }
+        samples[i].boot_time = now;
+        samples[i].fake_time = fake_rtc_file_timeline_time(&timeline, fake_rtc_sample_at(state->instance, &anchor, now,
+            request.spacing == 0 || i == 0));
+    }
+    rcu_read_unlock();
+    if (copy_to_user(u64_to_user_ptr(request.samples), samples, request.count * sizeof(*samples))) {
+        status = -EFAULT;
+    }
+    kvfree(samples);
+    return status;
+}
+
+/**
+ * @brief Convert user array of moments to fake times of open or back, see struct fake_rtc_evaluate_request
+ * 
+ * Uses the same transform as reads and the same inverse as alarm timer, with anchor read once for the whole array
+ * 
+ * @param state - state of open
+ * @param argument - userspace struct fake_rtc_evaluate_request
+ * @return long - status
+ */
+static long fake_rtc_evaluate(struct fake_rtc_file *state, const struct fake_rtc_evaluate_request __user *argument) {
+    struct fake_rtc_evaluate_request request;
+    struct fake_rtc_file_timeline timeline;
+    struct fake_rtc_anchor anchor;
+    s64 __user *user_times;
+    s64 *times;
+    ktime_t now;
+    bool saturated;
+    u32 i;
+    long status = 0;
+    if (copy_from_user(&request, argument, sizeof(request))) {
+        return -EFAULT;
+    }
+    if (request.count == 0 || request.count > FAKE_RTC_MAX_SAMPLES || (request.flags & ~FAKE_RTC_EVALUATE_INVERSE)) {
+        return -EINVAL;
+    }
+    user_times = u64_to_user_ptr(request.times);
+    times = kvmalloc_array(request.count, sizeof(*times), GFP_KERNEL);
+    if (times == NULL) {
+        return -ENOMEM;
+    }
+    if (copy_from_user(times, user_times, request.count * sizeof(*times))) {
+        kvfree(times);
+        return -EFAULT;
+    }
+    fake_rtc_file_read_timeline(state, &timeline);
+    rcu_read_lock();
+    fake_rtc_read_anchor(state->instance, &anchor);
+    if (request.flags & FAKE_RTC_EVALUATE_INVERSE) {
+        now = ktime_get();
+        for (i = 0; i < request.count; i++) {
+            times[i] = fake_rtc_deadline(&anchor, fake_rtc_file_timeline_inverse(&timeline, times[i]), now);
+        }
+    } else {
+        for (i = 0; i < request.count; i++) {
+            ktime_t boot_time = max_t(ktime_t, times[i], anchor.synchronized_boot_time);
+            times[i] = fake_rtc_file_timeline_time(&timeline, fake_rtc_time_at(&anchor, boot_time, &saturated));
+        }
+    }
+    rcu_read_unlock();
+    if (copy_to_user(user_times, times, request.count * sizeof(*times))) {
+        status = -EFAULT;
+    }
+    kvfree(times);
+    return status;
+}
+
+/**
+ * @brief ioctl function for /dev/fake_rtc
+ * 
+ * @param file 
+ * @param cmd - one of FAKE_RTC_* ioctl commands or RTC periodic interrupt commands
+ * @param arg - pointer to userspace argument of command, frequency for RTC_IRQP_SET
+ * @return long - status
+ */
+static long fake_rtc_dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    struct fake_rtc_file *state = file->private_data;
+    struct fake_rtc_anchor anchor;
+    s64 nanoseconds;
+    u64 missed;
+    switch (cmd) {
+    case FAKE_RTC_GET_TIME:
+        nanoseconds = fake_rtc_file_get_time(state, &anchor);
+        return put_user(nanoseconds, (s64 __user *)arg);
+    case FAKE_RTC_SET_TIMELINE:
+        return fake_rtc_set_timeline(state, (struct fake_rtc_timeline __user *)arg);
+    case FAKE_RTC_SAMPLE:
+        return fake_rtc_sample(state, (const struct fake_rtc_sample_request __user *)arg);
+    case FAKE_RTC_EVALUATE:
+        return fake_rtc_evaluate(state, (const struct fake_rtc_evaluate_request __user *)arg);
+    case FAKE_RTC_CLEAR_TIMELINE:
+        write_seqlock(&state->timeline_lock);
+        state->timeline.enabled = false;
+        write_sequnlock(&state->timeline_lock);
+        return 0;
+    case RTC_IRQP_READ:
+        return put_user(state->pie_freq, (unsigned long __user *)arg);
+    case RTC_IRQP_SET:
+    case RTC_PIE_ON:
+    case RTC_PIE_OFF:
+        return fake_rtc_pie_ioctl(state, cmd, arg);
+    case FAKE_RTC_PIE_MISSED:
+        spin_lock_irq(&state->lock);
+        missed = state->pie_missed;
+        spin_unlock_irq(&state->lock);
+        return put_user(missed, (u64 __user *)arg);
+    default:
+        return -ENOTTY;
+    }
+}
+
+#ifdef CONFIG_COMPAT
+/* RTC_IRQP_READ and RTC_IRQP_SET of 32-bit processes, their argument is 32-bit unsigned long */
+#define RTC_IRQP_READ32 _IOR('p', 0x0b, __u32)
+#define RTC_IRQP_SET32 _IOW('p', 0x0c, __u32)
+
+/**
+ * @brief compat ioctl function for /dev/fake_rtc
+ * 
+ * Periodic interrupt frequency commands have different numbers in 32-bit processes and are translated
+ * like in rtc_dev_compat_ioctl. Other commands take pointer to fixed-size data or no argument,
+ * so only pointer has to be converted
+ */
+static long fake_rtc_dev_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    struct fake_rtc_file *state = file->private_data;
+    void __user *argument = compat_ptr(arg);
+    switch (cmd) {
+    case RTC_IRQP_READ32:
+        return put_user(state->pie_freq, (__u32 __user *)argument);
+    case RTC_IRQP_SET32:
+        /* Argument is frequency, not pointer */
+        return fake_rtc_dev_ioctl(file, RTC_IRQP_SET, arg);
+    default:
+        return fake_rtc_dev_ioctl(file, cmd, (unsigned long)argument);
+    }
+}
+#endif
+
+static const struct file_operations fake_rtc_dev_ops = {
+    .owner = THIS_MODULE,
+    .open = fake_rtc_dev_open,
+    .release = fake_rtc_dev_release,
+    .read = fake_rtc_dev_read,
+    .poll = fake_rtc_dev_poll,
+    .llseek = no_llseek,
+    .mmap = fake_rtc_dev_mmap,
+    .unlocked_ioctl = fake_rtc_dev_ioctl,
+#ifdef CONFIG_COMPAT
+    .compat_ioctl = fake_rtc_dev_compat_ioctl
+#endif
+};
+
+static struct miscdevice fake_rtc_misc_device = {
+    .minor = MISC_DYNAMIC_MINOR,
+    .name = FAKE_RTC_DEVICE_NAME,
+    .fops = &fake_rtc_dev_ops,
+    .mode = 0444
+};
+
+/**
+ * @brief Names of modes accepted in /proc commands
+ */
+static const char *const fake_rtc_mode_names[MODES_NUMBER] = {
+    [REAL] = "real",
+    [RANDOM] = "random",
+    [ACCELERATED] = "accel",
+    [SLOWED] = "slow",
+    [SCHEDULE] = "schedule",
+    [TRACE] = "trace"
+};
+
+/**
+ * @brief Print status and configuration of instance
+ * 
+ * Shared by /proc/FakeRTC of default instance and status file of configfs instances
+ * 
+ * @param m - seq_file to print to
+ * @param instance - instance to describe
+ */
+static void fake_rtc_show_status(struct seq_file *m, struct fake_rtc_instance *instance) {
+    struct fake_rtc_anchor anchor;
+    struct fake_rtc_counters counters;
+    const struct fake_rtc_schedule *schedule;
+    const struct fake_rtc_trace *trace;
+    unsigned int segments;
+    u64 samples;
+    struct fake_rtc_oscillator oscillator;
+    s64 correction_ppb, offset_ppb, drift_ppb;
+    unsigned int seq;
+    do {
+        seq = read_seqbegin(&instance->anchor_lock);
+        oscillator = instance->oscillator;
+        correction_ppb = instance->correction_ppb;
+        offset_ppb = instance->offset_ppb;
+        drift_ppb = instance->drift_ppb;
+    } while (read_seqretry(&instance->anchor_lock, seq));
+    rcu_read_lock();
+    fake_rtc_read_anchor(instance, &anchor);
+    schedule = rcu_dereference(anchor.schedule);
+    segments = schedule == NULL ? 0 : schedule->count;
+    trace = rcu_dereference(anchor.trace);
+    samples = trace == NULL ? 0 : trace->samples.count;
+    rcu_read_unlock();
+    fake_rtc_sum_counters(instance, &counters);
+    seq_printf(m, "Time has been set %llu times and read %llu times\n"\
+    "Mode has been changed %llu times\n"\
+    "Time has been saturated at range limits %llu times\n"\
+    "Periodic interrupts missed by readers of /dev/%s: %llu\n"\
+    "Random seed: %llu\n"\
+    "Operating modes of this device:\n"\
+    "\t0 - Real time\n"\
+    "\t1 - Random time\n"\
+    "\t2 - Accelerated time\n"\
+    "\t3 - Slowed time\n"\
+    "\t4 - Schedule of segments\n"\
+    "\t5 - Replay of recorded trace\n"\
+    "Current operating mode: %d (%s)\n"\
+    "Segments in uploaded schedule: %u\n"\
+    "Samples in loaded trace: %llu\n"\
+    "Oscillator: skew %d ppb, wander %d ppb with period %llu ns, random walk %lld ppb (step %d ppb, limit %d ppb), jitter %u ns\n"\
+    "Frequency correction: PTP %lld ppb, RTC offset %lld ppb, oscillator drift %lld ppb\n"\
+    "Write commands to /proc/FakeRTC or to config file of configfs instance to change configuration, for example \"mode=accel rate=37/10 offset=-3600s\"\n"\
+    "Commands: mode=<real|random|accel|slow|schedule|trace|0-5> rate=<rate> offset=<duration> seed=<seed> bounds=<min:max> sync\n"\
+    "\tschedule=<duration>@<rate>,<jump>,... for example \"schedule=10s@1,60s@100,+1y,30s@0.2\"\n"\
+    "\ttrace=<firmware file name>\n"\
+    "\tskew=<ppb> wander=<ppb>:<period> walk=<step ppb>:<limit ppb> jitter=<duration>, ppb may be given as <number>ppm\n",\
+        counters.set, counters.read, counters.mode_change, counters.saturated, FAKE_RTC_DEVICE_NAME, counters.pie_missed, READ_ONCE(fake_rtc_random_seed),
+        anchor.mode, fake_rtc_mode_names[anchor.mode], segments, samples,
+        oscillator.skew_ppb, oscillator.wander_ppb, oscillator.wander_period, oscillator.walk_ppb, oscillator.walk_step_ppb, oscillator.walk_limit_ppb,
+        anchor.jitter, correction_ppb, offset_ppb, drift_ppb);
+}
+
+/**
+ * @brief show function for /proc interface
+ * 
+ * Message is generated into per-open seq_file buffer, so any number of readers can read /proc file at the same time
+ * 
+ * @param m - seq_file of this open, its private data is default instance
+ * @param v 
+ * @return int status
+ */
+static int fake_rtc_proc_show(struct seq_file *m, void *v) {
+    fake_rtc_show_status(m, m->private);
+    return 0;
+}
+
+static int fake_rtc_proc_open(struct inode * inode, struct file * file) {
+    return single_open(file, fake_rtc_proc_show, PDE_DATA(inode));
+}
+
+/**
+ * @brief Configuration change requested by one write to /proc file
+ * 
+ * All commands of one write are parsed into this struct first and then applied in one write section,
+ * so readers never see intermediate state
+ * 
+ * @sync - synchronize fake time with system time
+ * @has_mode - mode is given
+ * @mode - new mode
+ * @has_rate - rate is given, it is applied to new mode or to current mode if mode is not given
+ * @rate - new rate
+ * @has_offset - offset is given
+ * @offset - nanoseconds to add to fake time
+ * @has_seed - seed of random mode is given
+ * @seed - new seed
+ * @has_bounds - bounds of random mode coefficients are given
+ * @random_min - new smallest coefficient
+ * @random_range - new number of coefficients
+ * @schedule - new schedule, owned by this struct until it is applied
+ * @trace - new trace, owned by this struct until it is applied
+ * @has_skew - constant frequency error of oscillator is given
+ * @skew_ppb - new constant frequency error
+ * @has_wander - sinusoidal wander of oscillator is given
+ * @wander_ppb - new amplitude of wander
+ * @wander_period - new period of wander
+ * @has_walk - random walk of oscillator is given
+ * @walk_step_ppb - new largest step of random walk
+ * @walk_limit_ppb - new largest value of random walk
+ * @has_jitter - bound of jitter is given
+ * @jitter - new bound of jitter
+ */
+struct fake_rtc_config {
+    bool sync;
+    bool has_mode;
+    enum fake_rtc_mode mode;
+    bool has_rate;
+    struct fake_rtc_rate rate;
+    bool has_offset;
+    s64 offset;
+    bool has_seed;
+    u64 seed;
+    bool has_bounds;
+    s32 random_min;
+    u64 random_range;
+    struct fake_rtc_schedule *schedule;
+    struct fake_rtc_trace *trace;
+    bool has_skew;
+    s32 skew_ppb;
+    bool has_wander;
+    s32 wander_ppb;
+    u64 wander_period;
+    bool has_walk;
+    s32 walk_step_ppb;
+    s32 walk_limit_ppb;
+    bool has_jitter;
+    u32 jitter;
+};
+
+static int fake_rtc_parse_mode(const char *str, enum fake_rtc_mode *mode) {
+    int i;
+    for (i = 0; i < MODES_NUMBER; i++) {
+        if (!strcmp(str, fake_rtc_mode_names[i]) || (str[0] == '0' + i && str[1] == '\0')) {
+            *mode = i;
+            return 0;
+        }
+    }
+    return -EINVAL;
+}
+
+/**
+ * @brief Parse signed duration
+ * 
+ * Duration is integer with optional suffix: ns, us, ms, s, m, h, d or y (365 days). Seconds are used without suffix
+ * 
+ * @param str - duration, for example "-3600s" or "+1y"
+ * @param nanoseconds - where to store duration in nanoseconds
+ * @return int - status
+ */
+static int fake_rtc_parse_duration(const char *str, s64 *nanoseconds) {
+    static const struct {
+        const char *suffix;
+        s64 nanoseconds;
+    } units[] = {
+        { "ns", 1 },
+        { "us", NSEC_PER_USEC },
+        { "ms", NSEC_PER_MSEC },
+        { "s", NSEC_PER_SEC },
+        { "m", 60LL * NSEC_PER_SEC },
+        { "h", 3600LL * NSEC_PER_SEC },
+        { "d", 86400LL * NSEC_PER_SEC },
+        { "y", 365LL * 86400 * NSEC_PER_SEC }
+    };
+    char number[24];
+    size_t length = strspn(str, "+-0123456789");
+    s64 value;
+    s64 unit = NSEC_PER_SEC;
+    unsigned int i;
+    if (length == 0 || length >= sizeof(number)) {
+        return -EINVAL;
+    }
+    memcpy(number, str, length);
+    number[length] = '\0';
+    if (kstrtos64(number, 10, &value)) {
+        return -EINVAL;
+    }
+    if (str[length] != '\0') {
+        for (i = 0; i < ARRAY_SIZE(units) && strcmp(str + length, units[i].suffix); i++);
+        if (i == ARRAY_SIZE(units)) {
+            return -EINVAL;
+        }
+        unit = units[i].nanoseconds;
+    }
+    if (check_mul_overflow(value, unit, nanoseconds)) {
+        return -ERANGE;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parse frequency error
+ * 
+ * @param str - integer with optional suffix ppb or ppm, parts per billion are used without suffix
+ * @param ppb - where to store frequency error in parts per billion
+ * @return int - status
+ */
+static int fake_rtc_parse_ppb(const char *str, s32 *ppb) {
+    char number[24];
+    size_t length = strspn(str, "+-0123456789");
+    s64 value;
+    if (length == 0 || length >= sizeof(number)) {
+        return -EINVAL;
+    }
+    memcpy(number, str, length);
+    number[length] = '\0';
+    if (kstrtos64(number, 10, &value)) {
+        return -EINVAL;
+    }
+    if (!strcmp(str + length, "ppm")) {
+        if (check_mul_overflow(value, 1000LL, &value)) {
+            return -ERANGE;
+        }
+    } else if (str[length] != '\0' && strcmp(str + length, "ppb")) {
+        return -EINVAL;
+    }
+    if (value < -MAX_CORRECTION_PPB || value > MAX_CORRECTION_PPB) {
+        return -ERANGE;
+    }
+    *ppb = value;
+    return 0;
+}
+
+/**
+ * @brief Split value of command in form "first:second"
+ * 
+ * @param value - value to split, separator is replaced with terminating zero
+ * @return char* - second part, NULL if there is no separator
+ */
+static char *fake_rtc_split_pair(char *value) {
+    char *second = strchr(value, ':');
+    if (second != NULL) {
+        *second++ = '\0';
+    }
+    return second;
+}
+
+/**
+ * @brief Parse parameters of oscillator model
+ * 
+ * @param command - skew, wander, walk or jitter
+ * @param value - "<ppb>" for skew, "<ppb>:<period>" for wander, "<step ppb>:<limit ppb>" for walk, "<duration>" for jitter
+ * @param config - configuration change to fill
+ * @return int - status, -ENOENT if command is not a parameter of oscillator
+ */
+static int fake_rtc_parse_oscillator(const char *command, char *value, struct fake_rtc_config *config) {
+    char *second;
+    s64 nanoseconds;
+    if (!strcmp(command, "skew")) {
+        config->has_skew = true;
+        return fake_rtc_parse_ppb(value, &config->skew_ppb);
+    }
+    if (!strcmp(command, "jitter")) {
+        config->has_jitter = true;
+        if (fake_rtc_parse_duration(value, &nanoseconds) || nanoseconds < 0 || nanoseconds > MAX_JITTER_NS) {
+            return -EINVAL;
+        }
+        config->jitter = nanoseconds;
+        return 0;
+    }
+    if (!strcmp(command, "wander")) {
+        config->has_wander = true;
+        second = fake_rtc_split_pair(value);
+        if (second == NULL || fake_rtc_parse_ppb(value, &config->wander_ppb) ||
+                fake_rtc_parse_duration(second, &nanoseconds) || nanoseconds <= 0) {
+            return -EINVAL;
+        }
+        config->wander_period = nanoseconds;
+        return 0;
+    }
+    if (!strcmp(command, "walk")) {
+        config->has_walk = true;
+        second = fake_rtc_split_pair(value);
+        if (second == NULL || fake_rtc_parse_ppb(value, &config->walk_step_ppb) ||
+                fake_rtc_parse_ppb(second, &config->walk_limit_ppb) || config->walk_step_ppb < 0 || config->walk_limit_ppb < 0) {
+            return -EINVAL;
+        }
+        return 0;
+    }
+    return -ENOENT;
+}
+
+/**
+ * @brief Append segment to schedule being parsed
+ * 
+ * @param schedule - schedule with enough space for one more segment
+ * @param real_start - start of new segment, moved to its end
+ * @param fake_start - fake time at start of new segment, moved to its end
+ * @param duration - duration of segment in nanoseconds, negative if segment lasts forever
+ * @param rate - rate of segment
+ * @return int - status
+ */
+static int fake_rtc_schedule_append(struct fake_rtc_schedule *schedule, u64 *real_start, s64 *fake_start, s64 duration,
+        const struct fake_rtc_rate *rate) {
+    struct fake_rtc_segment *segment = &schedule->segments[schedule->count++];
+    u64 scaled;
+    segment->real_start = *real_start;
+    segment->fake_start = *fake_start;
+    fake_rtc_rate_to_fixed(rate->num, rate->den, &segment->mult, &segment->shift);
+    fake_rtc_rate_to_fixed(rate->den, rate->num, &segment->inverse_mult, &segment->inverse_shift);
+    if (duration < 0) {
+        return 0;
+    }
+    scaled = mul_u64_u64_shr_sat(duration, segment->mult, segment->shift);
+    if (scaled > S64_MAX || check_add_overflow(*fake_start, (s64)scaled, fake_start)) {
+        return -ERANGE;
+    }
+    *real_start += duration;
+    return *real_start > MAX_SCHEDULE_LENGTH ? -ERANGE : 0;
+}
+
+/**
+ * @brief Parse schedule and precompute starts of its segments
+ * 
+ * Schedule is a list of segments "<duration>@<rate>" and jumps "<duration>" separated by commas.
+ * For example "10s@1,60s@100,+1y,30s@0.2" is real time for 10 seconds, 100x for 60 seconds, jump by a year forward
+ * and 0.2x for 30 seconds. Duration of the last segment may be omitted, then it lasts forever.
+ * Otherwise time goes with real rate after the end of schedule
+ * 
+ * @param str - schedule, modified by parsing
+ * @param result - where to store allocated schedule
+ * @return int - status
+ */
+static int fake_rtc_parse_schedule(char *str, struct fake_rtc_schedule **result) {
+    static const struct fake_rtc_rate real_rate = { 1, 1 };
+    struct fake_rtc_schedule *schedule;
+    struct fake_rtc_rate rate;
+    unsigned int count = 2;
+    u64 real_start = 0;
+    s64 fake_start = 0;
+    s64 duration;
+    bool open_ended = false;
+    char *token;
+    char *separator;
+    int status = 0;
+    for (separator = str; *separator != '\0'; separator++) {
+        count += *separator == ',';
+    }
+    if (count > MAX_SCHEDULE_SEGMENTS) {
+        return -E2BIG;
+    }
+    schedule = kzalloc(struct_size(schedule, segments, count), GFP_KERNEL);
+    if (schedule == NULL) {
+        return -ENOMEM;
+    }
+    while (status == 0 && (token = strsep(&str, ",")) != NULL) {
+        if (open_ended) {
+            status = -EINVAL;
+            break;
+        }
+        separator = strchr(token, '@');
+        if (separator == NULL) {
+            status = fake_rtc_parse_duration(token, &duration);
+            if (status == 0 && check_add_overflow(fake_start, duration, &fake_start)) {
+                status = -ERANGE;
+            }
+            continue;
+        }
+        *separator = '\0';
+        status = fake_rtc_parse_rate(separator + 1, &rate);
+        if (status) {
+            break;
+        }
+        if (*token == '\0') {
+            open_ended = true;
+            duration = -1;
+        } else {
+            status = fake_rtc_parse_duration(token, &duration);
+            if (status == 0 && duration <= 0) {
+                status = -EINVAL;
+            }
+        }
+        if (status == 0) {
+            status = fake_rtc_schedule_append(schedule, &real_start, &fake_start, duration, &rate);
+        }
+    }
+    if (status == 0 && !open_ended) {
+        status = fake_rtc_schedule_append(schedule, &real_start, &fake_start, -1, &real_rate);
+    }
+    if (status) {
+        kfree(schedule);
+        return status;
+    }
+    *result = schedule;
+    return 0;
+}
+
+static void fake_rtc_free_trace(struct rcu_head *head) {
+    kvfree(container_of(head, struct fake_rtc_trace, rcu));
+}
+
+/**
+ * @brief Load trace with request_firmware and decode it
+ * 
+ * File format is described in fake_rtc_uapi.h. Deltas are summed here once,
+ * so reading time doesn't depend on position in trace. Name must be a plain file name,
+ * so it can't point outside of firmware search path
+ * 
+ * @param instance - instance of fake clock
+ * @param name - name of file in firmware search path
+ * @param result - where to store allocated trace
+ * @return int - status
+ */
+static int fake_rtc_load_trace(struct fake_rtc_instance *instance, const char *name, struct fake_rtc_trace **result) {
+    const struct firmware *firmware;
+    const struct fake_rtc_trace_header *header;
+    const __le32 *deltas;
+    struct fake_rtc_trace *trace;
+    u64 count;
+    u64 i;
+    int status;
+    if (*name == '\0' || strchr(name, '/') != NULL || strstr(name, "..") != NULL) {
+        return -EINVAL;
+    }
+    status = request_firmware(&firmware, name, &(instance->pdev->dev));
+    if (status) {
+        return status;
+    }
+    status = -EINVAL;
+    header = (const struct fake_rtc_trace_header *)firmware->data;
+    if (firmware->size < sizeof(*header) || le32_to_cpu(header->magic) != FAKE_RTC_TRACE_MAGIC ||
+            le32_to_cpu(header->version) != FAKE_RTC_TRACE_VERSION || le64_to_cpu(header->interval) == 0) {
+        goto release_firmware;
+    }
+    count = le64_to_cpu(header->count);
+    if (count == 0 || count > MAX_TRACE_SAMPLES || firmware->size != sizeof(*header) + (count - 1) * sizeof(*deltas)) {
+        goto release_firmware;
+    }
+    trace = kvmalloc(struct_size(trace, offsets, count), GFP_KERNEL);
+    if (trace == NULL) {
+        status = -ENOMEM;
+        goto release_firmware;
+    }
+    trace->samples.interval = le64_to_cpu(header->interval);
+    fake_rtc_rate_to_fixed(1, trace->samples.interval, &trace->samples.inverse_mult, &trace->samples.inverse_shift);
+    trace->samples.count = count;
+    trace->samples.offsets = trace->offsets;
+    trace->offsets[0] = 0;
+    deltas = (const __le32 *)(header + 1);
+    for (i = 1; i < count; i++) {
+        trace->offsets[i] = trace->offsets[i - 1] + (s32)le32_to_cpu(deltas[i - 1]);
+    }
+    *result = trace;
+    status = 0;
+release_firmware:
+    release_firmware(firmware);
+    return status;
+}
 
 /**
- * Feel free to change this contants to change accelerating and slowing behavior
- * But keep it natural numbers
+ * @brief Parse one command of /proc interface
+ * 
+ * @param instance - instance of fake clock
+ * @param command - command in form key=value, or just a mode digit for compatibility
+ * @param config - configuration change to fill
+ * @return int - status
  */
-#define ACCELERATING_COEFFICIENT 2
-#define SLOWING_COEFFICIENT 5
+static int fake_rtc_parse_command(struct fake_rtc_instance *instance, char *command, struct fake_rtc_config *config) {
+    char *value = strchr(command, '=');
+    int status;
+    if (value == NULL) {
+        if (!strcmp(command, "sync")) {
+            config->sync = true;
+            return 0;
+        }
+        config->has_mode = true;
+        return fake_rtc_parse_mode(command, &config->mode);
+    }
+    *value++ = '\0';
+    if (!strcmp(command, "mode")) {
+        config->has_mode = true;
+        return fake_rtc_parse_mode(value, &config->mode);
+    }
+    if (!strcmp(command, "rate")) {
+        config->has_rate = true;
+        return fake_rtc_parse_rate(value, &config->rate);
+    }
+    if (!strcmp(command, "offset")) {
+        config->has_offset = true;
+        return fake_rtc_parse_duration(value, &config->offset);
+    }
+    if (!strcmp(command, "seed")) {
+        config->has_seed = true;
+        return kstrtou64(value, 0, &config->seed);
+    }
+    if (!strcmp(command, "bounds")) {
+        config->has_bounds = true;
+        return fake_rtc_parse_random_bounds(value, &config->random_min, &config->random_range);
+    }
+    if (!strcmp(command, "schedule")) {
+        kfree(config->schedule);
+        config->schedule = NULL;
+        return fake_rtc_parse_schedule(value, &config->schedule);
+    }
+    if (!strcmp(command, "trace")) {
+        kvfree(config->trace);
+        config->trace = NULL;
+        return fake_rtc_load_trace(instance, value, &config->trace);
+    }
+    status = fake_rtc_parse_oscillator(command, value, config);
+    return status == -ENOENT ? -EINVAL : status;
+}
 
-#define DEVICE_NAME "FakeRTC"
-#define NANOSECONDS_IN_SECOND 1000000000
-#define PROC_MSG_LEN 1024
+/**
+ * @brief Apply configuration change as one change of anchor
+ * 
+ * Commands are applied in fixed order: sync, offset, mode, rate, bounds, seed, oscillator.
+ * Schedule and trace imply their modes. Timeline starts from current fake time when it is uploaded or its mode is chosen,
+ * and fake time doesn't jump when its mode is left
+ * 
+ * @param instance - instance of fake clock
+ * @param config - parsed configuration change. Its schedule and trace are taken by this function on success
+ * @return int - status
+ */
+static int fake_rtc_apply_config(struct fake_rtc_instance *instance, const struct fake_rtc_config *config) {
+    struct fake_rtc_schedule *old_schedule = NULL;
+    struct fake_rtc_trace *old_trace = NULL;
+    struct fake_rtc_oscillator *oscillator = &instance->oscillator;
+    bool oscillator_changed = config->has_skew || config->has_wander || config->has_walk;
+    const char *error = NULL;
+    enum fake_rtc_mode target;
+    bool mode_changed;
+    bool dynamic;
+    anchor_write_begin(instance);
+    if (config->has_mode) {
+        target = config->mode;
+    } else if (config->schedule != NULL) {
+        target = SCHEDULE;
+    } else if (config->trace != NULL) {
+        target = TRACE;
+    } else {
+        target = instance->anchor.mode;
+    }
+    if (config->has_rate && target != ACCELERATED && target != SLOWED) {
+        error = "Rate can be set only for accelerated and slowed modes";
+    } else if ((config->schedule != NULL && target != SCHEDULE) || (config->trace != NULL && target != TRACE)) {
+        error = "Schedule and trace can be uploaded only together with their modes";
+    } else if ((target == SCHEDULE && config->schedule == NULL && rcu_access_pointer(instance->anchor.schedule) == NULL) ||
+            (target == TRACE && config->trace == NULL && rcu_access_pointer(instance->anchor.trace) == NULL)) {
+        error = "Schedule and trace modes require uploaded schedule or trace";
+    }
+    if (error != NULL) {
+        anchor_write_abort(instance);
+        dev_warn(&(instance->pdev->dev), "%s", error);
+        return -EINVAL;
+    }
+    if (oscillator_changed && fake_rtc_mode_is_linear(instance->anchor.mode)) {
+        /* Old frequency error applies to time passed before this change */
+        rebase_locked(instance);
+    }
+    if (fake_rtc_mode_has_timeline(target) ? config->has_mode || config->schedule != NULL || config->trace != NULL :
+            fake_rtc_mode_has_timeline(instance->anchor.mode)) {
+        move_anchor_locked(instance);
+    }
+    if (config->sync) {
+        instance->anchor.synchronized_real_time = ktime_get_real();
+        instance->anchor.synchronized_boot_time = ktime_get();
+        trace_fake_rtc_set(instance->anchor.synchronized_boot_time, instance->anchor.synchronized_real_time);
+    }
+    if (config->has_offset) {
+        shift_time_locked(instance, config->offset);
+    }
+    if (config->has_rate) {
+        instance->rates[target] = config->rate;
+    }
+    if (config->schedule != NULL) {
+        old_schedule = rcu_dereference_protected(instance->anchor.schedule, lockdep_is_held(&instance->anchor_lock.lock));
+        rcu_assign_pointer(instance->anchor.schedule, config->schedule);
+    }
+    if (config->trace != NULL) {
+        old_trace = rcu_dereference_protected(instance->anchor.trace, lockdep_is_held(&instance->anchor_lock.lock));
+        rcu_assign_pointer(instance->anchor.trace, config->trace);
+    }
+    mode_changed = target != instance->anchor.mode;
+    if (mode_changed) {
+        trace_fake_rtc_mode_change(instance->anchor.mode, target);
+    }
+    instance->anchor.mode = target;
+    update_transform_locked(instance);
+    if (config->has_bounds) {
+        instance->anchor.random_min = config->random_min;
+        instance->anchor.random_range = config->random_range;
+    }
+    if (config->has_seed) {
+        fake_rtc_random_seed_given = true;
+        set_random_seed(config->seed);
+    }
+    if (config->has_skew) {
+        oscillator->skew_ppb = config->skew_ppb;
+    }
+    if (config->has_wander) {
+        oscillator->wander_ppb = config->wander_ppb;
+        oscillator->wander_period = config->wander_period;
+    }
+    if (config->has_walk) {
+        oscillator->walk_step_ppb = config->walk_step_ppb;
+        oscillator->walk_limit_ppb = config->walk_limit_ppb;
+        oscillator->walk_ppb = clamp_t(s64, oscillator->walk_ppb, -oscillator->walk_limit_ppb, oscillator->walk_limit_ppb);
+    }
+    if (config->has_jitter) {
+        instance->anchor.jitter = config->jitter;
+    }
+    if (oscillator_changed || config->has_mode || config->schedule != NULL || config->trace != NULL) {
+        oscillator_update_locked(instance, false);
+    }
+    dynamic = oscillator_is_dynamic(instance);
+    anchor_write_end(instance);
+    if (dynamic) {
+        mod_delayed_work(system_wq, &instance->oscillator_work, msecs_to_jiffies(OSCILLATOR_UPDATE_MS));
+    }
+    if (old_schedule != NULL) {
+        kfree_rcu(old_schedule, rcu);
+    }
+    if (old_trace != NULL) {
+        call_rcu(&old_trace->rcu, fake_rtc_free_trace);
+    }
+    if (mode_changed) {
+        this_cpu_inc(instance->counters->mode_change);
+        fake_rtc_stats_mode_change(target);
+    }
+    return 0;
+}
 
 /**
- * @brief Enum of operating modes for this module
+ * @brief Parse and apply list of commands
  * 
- * Real - for real time, corresponding to system time
- * Random - for randomized time from last sychronization
- * Accelerated - time goes faster than real. How much faster - defined by ACCELERATING_COEFFICIENT
- * Slowed - time goes slower than real. How much slower - defined by SLOWING_COEFFICIENT
+ * Input is a list of commands separated by spaces or new lines, for example "mode=accel rate=37/10 offset=-3600s".
+ * Whole list is applied as one configuration change, or not applied at all if any command is invalid
+ * 
+ * @param instance - instance to configure
+ * @param input - commands, modified by parsing
+ * @return int - status
  */
-static enum {
-    REAL,
-    RANDOM,
-    ACCELERATED,
-    SLOWED
-} mode = REAL;
+static int fake_rtc_configure(struct fake_rtc_instance *instance, char *input) {
+    struct fake_rtc_config config = {0};
+    char *commands = NULL;
+    char *cursor = input;
+    char *command;
+    int status = 0;
+    if (trace_fake_rtc_config_enabled()) {
+        commands = kstrdup(strim(input), GFP_KERNEL);
+    }
+    while ((command = strsep(&cursor, " \t\n")) != NULL) {
+        if (*command == '\0') {
+            continue;
+        }
+        status = fake_rtc_parse_command(instance, command, &config);
+        if (status) {
+            dev_warn(&(instance->pdev->dev), "Invalid command \"%s\"", command);
+            break;
+        }
+    }
+    if (status == 0) {
+        status = fake_rtc_apply_config(instance, &config);
+    }
+    if (commands != NULL) {
+        trace_fake_rtc_config(commands, status);
+        kfree(commands);
+    }
+    if (status) {
+        kfree(config.schedule);
+        kvfree(config.trace);
+    }
+    return status;
+}
 
 /**
- * @brief Struct to represent this device
+ * @brief write function for /proc interface
  * 
- * @rtc_dev - rtc device registered in kernel
- * @pdev - registeredd platform device used to register rtc device
- * @proc_entry - entry to /proc dir corresponding to this module
- * @synchronized_real_time - time is nanoseconds used as starting point in time measurement. Synchronization takes place in init
- * @synchronized_boot_time - time in nanoseconds used to calculate time difference between measurement and synchronization which takes place in init and time set
- * @device_proc_open - used as variable for /proc file state (opened/closed) to forbid parallel access
+ * Configures default instance, see fake_rtc_configure.
+ * File is world-writable, so CAP_SYS_TIME is checked against credentials of the opener, not of the writer
+ * 
+ * @param filp 
+ * @param buff 
+ * @param len 
+ * @param off 
+ * @return ssize_t 
  */
-static struct fake_rtc_info {
-    struct rtc_device *rtc_dev;
-    struct platform_device *pdev;
-    struct proc_dir_entry *proc_entry;
-    ktime_t synchronized_real_time;
-    ktime_t synchronized_boot_time;
-    int8_t device_proc_open;
-    uint64_t read_counter;
-    uint64_t set_counter;
-} fake_rtc;
+static ssize_t fake_rtc_proc_write(struct file *filp, const char __user *buff, size_t len, loff_t * off) {
+    struct fake_rtc_instance *instance = PDE_DATA(file_inode(filp));
+    char *input;
+    int status;
+    if (!file_ns_capable(filp, &init_user_ns, CAP_SYS_TIME)) {
+        return -EPERM;
+    }
+    if (len == 0 || len > PROC_WRITE_MAX_LEN || *off > 0) {
+        dev_warn(&(instance->pdev->dev), "This module expects commands of at most %d bytes without offset in proc inputs", PROC_WRITE_MAX_LEN);
+        return -EINVAL;
+    }
+    input = memdup_user_nul(buff, len);
+    if (IS_ERR(input)) {
+        return PTR_ERR(input);
+    }
+    status = fake_rtc_configure(instance, input);
+    kfree(input);
+    return status ? status : len;
+}
+
+static const struct file_operations fake_rtc_proc_ops = {
+    .owner = THIS_MODULE,
+    .open = fake_rtc_proc_open,
+    .release = single_release,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .write = fake_rtc_proc_write
+};
+
+/**
+ * @brief Print histogram of latencies to debugfs file
+ * 
+ * Only buckets from the first to the last non-empty one are printed
+ * 
+ * @param m - seq_file of this open
+ * @param name - name of operation
+ * @param histogram - summed histogram
+ * @param max - largest latency in nanoseconds
+ */
+static void fake_rtc_show_latency(struct seq_file *m, const char *name, const u64 *histogram, u64 max) {
+    int first = 0;
+    int last = LATENCY_BUCKETS - 1;
+    int i;
+    while (first < LATENCY_BUCKETS && histogram[first] == 0) {
+        first++;
+    }
+    while (last > first && histogram[last] == 0) {
+        last--;
+    }
+    seq_printf(m, "%s latency, max %llu ns\n", name, max);
+    for (i = first; i <= last; i++) {
+        u64 low = i == 0 ? 0 : 1ULL << (i - 1);
+        if (i == LATENCY_BUCKETS - 1) {
+            seq_printf(m, "\t%12llu ns and more: %llu\n", low, histogram[i]);
+        } else {
+            seq_printf(m, "\t%12llu - %12llu ns: %llu\n", low, (1ULL << i) - 1, histogram[i]);
+        }
+    }
+}
 
 /**
- * @brief Buffer for mesage displayed when /proc file is read
+ * @brief show function for statistics in debugfs
  * 
+ * @param m - seq_file of this open
+ * @param v 
+ * @return int - status
  */
-static char proc_msg[PROC_MSG_LEN] = {0};
-static char* proc_msg_ptr = proc_msg;
+static int fake_rtc_stats_show(struct seq_file *m, void *v) {
+    struct fake_rtc_stats *stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+    int mode;
+    if (stats == NULL) {
+        return -ENOMEM;
+    }
+    fake_rtc_sum_stats(stats);
+    seq_printf(m, "Statistics are %s\n", static_key_enabled(&fake_rtc_stats_enabled) ? "enabled" : "disabled");
+    fake_rtc_show_latency(m, "Read", stats->read_latency, stats->read_max);
+    fake_rtc_show_latency(m, "Set", stats->set_latency, stats->set_max);
+    seq_puts(m, "Mode\treads\tchanges\n");
+    for (mode = 0; mode < MODES_NUMBER; mode++) {
+        seq_printf(m, "%s\t%llu\t%llu\n", fake_rtc_mode_names[mode], stats->mode_reads[mode], stats->mode_changes[mode]);
+    }
+    kfree(stats);
+    return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(fake_rtc_stats);
 
-static void synchronize_boot_time(void) {
-    fake_rtc.synchronized_boot_time = ktime_get();
+static int fake_rtc_stats_enable_get(void *data, u64 *value) {
+    *value = static_key_enabled(&fake_rtc_stats_enabled);
+    return 0;
 }
 
-static void synchronize_real_time(void) {
-    fake_rtc.synchronized_real_time = ktime_get_real();
+static int fake_rtc_stats_enable_set(void *data, u64 value) {
+    if (value) {
+        static_branch_enable(&fake_rtc_stats_enabled);
+    } else {
+        static_branch_disable(&fake_rtc_stats_enabled);
+    }
+    return 0;
 }
 
+DEFINE_DEBUGFS_ATTRIBUTE(fake_rtc_stats_enable_fops, fake_rtc_stats_enable_get, fake_rtc_stats_enable_set, "%llu\n");
+
 /**
- * @brief Get the accelerated time
- *  
- * @param nanoseconds_difference - nanoseconds from last synchronization
- * @return ktime_t - time from January 1st 1970 in accelerated mode 
+ * @brief Reset statistics of all CPUs
+ * 
+ * Operations finishing concurrently on other CPUs may survive reset, which is fine for statistics
+ * 
+ * @param data 
+ * @param value - ignored
+ * @return int - status
  */
-static ktime_t get_accelerated_time(unsigned long nanoseconds_difference) {
-    return (ktime_t) {
-        fake_rtc.synchronized_real_time + nanoseconds_difference * ACCELERATING_COEFFICIENT
-    };
+static int fake_rtc_stats_reset(void *data, u64 value) {
+    int cpu;
+    for_each_possible_cpu(cpu) {
+        memset(per_cpu_ptr(&fake_rtc_stats, cpu), 0, sizeof(struct fake_rtc_stats));
+    }
+    return 0;
 }
 
+DEFINE_DEBUGFS_ATTRIBUTE(fake_rtc_stats_reset_fops, NULL, fake_rtc_stats_reset, "%llu\n");
+
 /**
- * @brief Get the slowed time
+ * @brief Create debugfs directory with statistics
  * 
- * @param nanoseconds_difference - nanoseconds from last synchronization
- * @return time_t - time from January 1st 1970 in slowed mode 
- */
-static ktime_t get_slowed_time(unsigned long nanoseconds_difference) {
-    /* We need this counter because of the way hwclopck util works.
-     * It won't return any result until seconds on clock will change.
-     * To make it work we will add a second dor odd call and we won't for even call.
-     * So without this counter hwclock will throw a timeout error
-    */
-    static int call_counter;
-    call_counter++;
-    return (ktime_t) {
-        fake_rtc.synchronized_real_time + nanoseconds_difference / SLOWING_COEFFICIENT + (call_counter % 2) * NANOSECONDS_IN_SECOND
-    };
+ * Errors of debugfs are not checked: module works without it
+ */
+static void fake_rtc_debugfs_init(void) {
+    fake_rtc_debugfs_dir = debugfs_create_dir(FAKE_RTC_DEVICE_NAME, NULL);
+    debugfs_create_file("stats", 0444, fake_rtc_debugfs_dir, NULL, &fake_rtc_stats_fops);
+    debugfs_create_file_unsafe("enable", 0644, fake_rtc_debugfs_dir, NULL, &fake_rtc_stats_enable_fops);
+    debugfs_create_file_unsafe("reset", 0200, fake_rtc_debugfs_dir, NULL, &fake_rtc_stats_reset_fops);
 }
 
 /**
- * @brief Get the randomized time 
+ * @brief Allocate instance with initial configuration
  * 
- * @param nanoseconds_difference - nanoseconds from last synchronization
- * @return time_t - time from January 1st 1970 in random mode 
- */
-static ktime_t get_randomized_time(unsigned long nanoseconds_difference) {
-    static int call_counter;
-    int8_t random_byte;
-    int8_t coefficient;
-    call_counter++;
-    get_random_bytes(&random_byte, 1);
-    coefficient = random_byte % 10;
-    return (ktime_t) {
-            fake_rtc.synchronized_real_time + nanoseconds_difference * coefficient + (call_counter % 2) * NANOSECONDS_IN_SECOND
-    };
+ * Rates and random bounds are taken from module parameters, fake time is synchronized with system time.
+ * Devices are registered separately, see fake_rtc_instance_register
+ * 
+ * @return struct fake_rtc_instance* - new instance, NULL if there is not enough memory
+ */
+static struct fake_rtc_instance *fake_rtc_instance_alloc(void) {
+    struct fake_rtc_instance *instance = kmem_cache_zalloc(fake_rtc_instance_cache, GFP_KERNEL);
+    if (instance == NULL) {
+        return NULL;
+    }
+    instance->counters = alloc_percpu(struct fake_rtc_counters);
+    if (instance->counters == NULL) {
+        kmem_cache_free(fake_rtc_instance_cache, instance);
+        return NULL;
+    }
+    seqlock_init(&instance->anchor_lock);
+    instance->anchor.mode = REAL;
+    mutex_lock(&fake_rtc_instances_mutex);
+    memcpy(instance->rates, fake_rtc_rates, sizeof(instance->rates));
+    instance->anchor.random_min = fake_rtc_random_min;
+    instance->anchor.random_range = fake_rtc_random_range;
+    mutex_unlock(&fake_rtc_instances_mutex);
+    instance->ptp_info = fake_rtc_ptp_info;
+    hrtimer_init(&instance->alarm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+    instance->alarm_timer.function = fake_rtc_alarm_fire;
+    INIT_DELAYED_WORK(&instance->oscillator_work, oscillator_work_fn);
+    anchor_write_begin(instance);
+    update_transform_locked(instance);
+    anchor_write_end(instance);
+    synchronize_time(instance, ktime_get_real());
+    return instance;
 }
 
-static ktime_t get_real_time(unsigned long nanoseconds_difference) {
-    return fake_rtc.synchronized_real_time + nanoseconds_difference;
+/**
+ * @brief Allocate page of instance for mmap of /dev/fake_rtc and publish anchor to it
+ * 
+ * Default instance gets its page on load, configfs instances when they are bound to pid namespace
+ * 
+ * @param instance - instance without page
+ * @return int - status
+ */
+static int fake_rtc_instance_alloc_page(struct fake_rtc_instance *instance) {
+    struct fake_rtc_page *page = (struct fake_rtc_page *)get_zeroed_page(GFP_KERNEL);
+    if (page == NULL) {
+        return -ENOMEM;
+    }
+    page->version = FAKE_RTC_PAGE_VERSION;
+    anchor_write_begin(instance);
+    instance->page = page;
+    anchor_write_end(instance);
+    return 0;
 }
 
 /**
- * @brief Array of function pointers used to access calculating function corresponding to mode
+ * @brief Free instance which devices are already unregistered
  * 
+ * Timers are stopped by fake_rtc_instance_unregister, instances which failed registration never armed them.
+ * Schedule and trace are freed after RCU grace period like replaced ones
+ * 
+ * @param instance - instance to free
  */
-static ktime_t (*fake_rtc_accessors[])(unsigned long) = {
-    [REAL] = get_real_time,
-    [RANDOM] = get_randomized_time,
-    [ACCELERATED] = get_accelerated_time,
-    [SLOWED] = get_slowed_time
-};
+static void fake_rtc_instance_free(struct fake_rtc_instance *instance) {
+    struct fake_rtc_schedule *schedule = rcu_dereference_protected(instance->anchor.schedule, true);
+    struct fake_rtc_trace *trace = rcu_dereference_protected(instance->anchor.trace, true);
+    if (schedule != NULL) {
+        kfree_rcu(schedule, rcu);
+    }
+    if (trace != NULL) {
+        call_rcu(&trace->rcu, fake_rtc_free_trace);
+    }
+    free_page((unsigned long)instance->page);
+    free_percpu(instance->counters);
+    kmem_cache_free(fake_rtc_instance_cache, instance);
+}
 
 /**
- * @brief read time function, part of rtc interface
+ * @brief Register platform device and RTC device of instance
  * 
- * This function calculates nanoseconds spent from last synchronization and use it to get time value based on mode
- * Because calculating fuction returns nanoseconds from January 1st 1970, this function converts it to rtc_time
+ * RTC callbacks find instance in driver data of platform device
  * 
- * @param dev 
- * @param tm 
+ * @param instance - instance to register
+ * @param id - id of platform device, -1 for default instance
  * @return int - status
  */
-static int fake_rtc_read_time(struct device * dev, struct rtc_time * tm) {
-    unsigned long nanosec_from_sync = ktime_get() - fake_rtc.synchronized_boot_time;
-    ktime_t my_time = fake_rtc_accessors[mode](nanosec_from_sync);
-    rtc_time64_to_tm(my_time / NANOSECONDS_IN_SECOND, tm);
-    fake_rtc.read_counter++;
+static int fake_rtc_instance_register(struct fake_rtc_instance *instance, int id) {
+    struct device* associated_device;
+    int status;
+    instance->pdev = platform_device_register_simple(DEVICE_NAME, id, NULL, 0);
+    if (IS_ERR(instance->pdev)) {
+        return PTR_ERR(instance->pdev);
+    }
+    associated_device = &(instance->pdev->dev);
+    platform_set_drvdata(instance->pdev, instance);
+    device_init_wakeup(associated_device, true);
+    instance->rtc_dev = devm_rtc_allocate_device(associated_device);
+    if (IS_ERR(instance->rtc_dev)) {
+        dev_err(associated_device, "RTC device allocation failed");
+        status = PTR_ERR(instance->rtc_dev);
+        goto unregister_platform_device;
+    }
+    instance->rtc_dev->ops = &fake_rtc_operations;
+    instance->rtc_dev->range_min = MIN_FAKE_TIME / NANOSECONDS_IN_SECOND;
+    instance->rtc_dev->range_max = MAX_FAKE_TIME / NANOSECONDS_IN_SECOND;
+    status = rtc_register_device(instance->rtc_dev);
+    if (status) {
+        dev_err(associated_device, "RTC device registration failed");
+        goto unregister_platform_device;
+    }
     return 0;
+
+unregister_platform_device:
+    platform_device_unregister(instance->pdev);
+    return status;
 }
 
 /**
- * @brief set time function, part of rtc interface
+ * @brief Register PTP clock of instance
  * 
- * @param dev 
- * @param tm 
- * @return int - status
+ * @param instance - instance with registered platform device
+ * @return int - status, -EOPNOTSUPP if kernel is built without PTP support
  */
-static int fake_rtc_set_time(struct device * dev, struct rtc_time * tm) {
-    fake_rtc.synchronized_real_time = rtc_tm_to_ktime(*tm);
-    synchronize_boot_time();
-    fake_rtc.set_counter++;
+static int fake_rtc_instance_register_ptp(struct fake_rtc_instance *instance) {
+    struct ptp_clock *clock = ptp_clock_register(&instance->ptp_info, &(instance->pdev->dev));
+    if (IS_ERR_OR_NULL(clock)) {
+        return clock == NULL ? -EOPNOTSUPP : PTR_ERR(clock);
+    }
+    instance->ptp_clock = clock;
     return 0;
 }
 
-static const struct rtc_class_ops fake_rtc_operations = {
-    .read_time = fake_rtc_read_time,
-    .set_time = fake_rtc_set_time
-};
+/**
+ * @brief Unregister all devices of instance and stop its timers
+ * 
+ * RTC and PTP cores wait for running callbacks, so instance is not used by them after return.
+ * RTC core doesn't disable armed alarm on unregistration, and alarm timer passes RTC device to rtc_update_irq,
+ * so RTC device is kept until alarm timer and oscillator work, which rearms it, are cancelled
+ * 
+ * @param instance - instance to unregister
+ */
+static void fake_rtc_instance_unregister(struct fake_rtc_instance *instance) {
+    struct device *rtc_device = get_device(&instance->rtc_dev->dev);
+    if (instance->ptp_clock != NULL) {
+        ptp_clock_unregister(instance->ptp_clock);
+        instance->ptp_clock = NULL;
+    }
+    platform_device_unregister(instance->pdev);
+    WRITE_ONCE(instance->alarm_enabled, false);
+    cancel_delayed_work_sync(&instance->oscillator_work);
+    hrtimer_cancel(&instance->alarm_timer);
+    put_device(rtc_device);
+}
+
+#if IS_ENABLED(CONFIG_CONFIGFS_FS)
+
+static struct fake_rtc_instance *to_fake_rtc_instance(struct config_item *item) {
+    return container_of(item, struct fake_rtc_instance, item);
+}
+
+/**
+ * @brief Write to config file of configfs instance
+ * 
+ * Accepts the same commands as /proc/FakeRTC, see fake_rtc_configure
+ */
+static ssize_t fake_rtc_instance_config_store(struct config_item *item, const char *page, size_t count) {
+    char *input;
+    int status;
+    if (count == 0 || count > PROC_WRITE_MAX_LEN) {
+        return -EINVAL;
+    }
+    input = kmemdup_nul(page, count, GFP_KERNEL);
+    if (input == NULL) {
+        return -ENOMEM;
+    }
+    status = fake_rtc_configure(to_fake_rtc_instance(item), input);
+    kfree(input);
+    return status ? status : count;
+}
 
 /**
- * @brief open function for /proc interface
+ * @brief Read of status file of configfs instance
  * 
- * This function checks if someone has already opened device and if not it prepares message for user and occupies device
+ * configfs gives one page for the whole file, so status is printed into it through seq_file on stack
+ */
+static ssize_t fake_rtc_instance_status_show(struct config_item *item, char *page) {
+    struct seq_file m = {
+        .buf = page,
+        .size = PAGE_SIZE
+    };
+    fake_rtc_show_status(&m, to_fake_rtc_instance(item));
+    return seq_has_overflowed(&m) ? -EFBIG : m.count;
+}
+
+static ssize_t fake_rtc_instance_rtc_show(struct config_item *item, char *page) {
+    return sprintf(page, "%s\n", dev_name(&to_fake_rtc_instance(item)->rtc_dev->dev));
+}
+
+static ssize_t fake_rtc_instance_ptp_show(struct config_item *item, char *page) {
+    struct fake_rtc_instance *instance = to_fake_rtc_instance(item);
+    ssize_t length;
+    mutex_lock(&fake_rtc_instances_mutex);
+    if (instance->ptp_clock == NULL) {
+        length = sprintf(page, "none\n");
+    } else {
+        length = sprintf(page, "ptp%d\n", ptp_clock_index(instance->ptp_clock));
+    }
+    mutex_unlock(&fake_rtc_instances_mutex);
+    return length;
+}
+
+/**
+ * @brief Write to ptp file of configfs instance
  * 
- * @param inode 
- * @param file 
- * @return int status
+ * PTP clock takes several kilobytes, so it is registered only when 1 is written and unregistered when 0 is written
  */
-static int fake_rtc_proc_open(struct inode * inode, struct file * file) {
-    if (fake_rtc.device_proc_open) {
-        return -EBUSY;
+static ssize_t fake_rtc_instance_ptp_store(struct config_item *item, const char *page, size_t count) {
+    struct fake_rtc_instance *instance = to_fake_rtc_instance(item);
+    bool enable;
+    int status = kstrtobool(page, &enable);
+    if (status) {
+        return status;
     }
-    fake_rtc.device_proc_open++;
-    sprintf(proc_msg, "Time has been set %llu times and read %llu times\n"\
-    "Operating modes of this device:\n"\
-    "\t0 - Real time\n"\
-    "\t1 - Random time\n"\
-    "\t2 - Accelerated time\n"\
-    "\t3 - Slowed time\n"\
-    "Current operating mode: %d\n"\
-    "Write mode number to this file to change operating mode\n",\
-        fake_rtc.set_counter, fake_rtc.read_counter, mode);
-    proc_msg_ptr = proc_msg;
-    try_module_get(THIS_MODULE);
-    return 0;
+    mutex_lock(&fake_rtc_instances_mutex);
+    if (enable && instance->ptp_clock == NULL) {
+        status = fake_rtc_instance_register_ptp(instance);
+    } else if (!enable && instance->ptp_clock != NULL) {
+        ptp_clock_unregister(instance->ptp_clock);
+        instance->ptp_clock = NULL;
+    }
+    mutex_unlock(&fake_rtc_instances_mutex);
+    return status ? status : count;
+}
+
+/**
+ * @brief Remove binding of instance to pid namespace
+ * 
+ * Waits for readers which could find instance in fake_rtc_views, so instance can be freed or bound again after return.
+ * Must be called with fake_rtc_instances_mutex held
+ * 
+ * @param instance - configfs instance
+ */
+static void fake_rtc_instance_unbind_locked(struct fake_rtc_instance *instance) {
+    struct pid_namespace *ns = instance->pid_ns;
+    if (ns == NULL) {
+        return;
+    }
+    hash_del_rcu(&instance->view_node);
+    synchronize_rcu();
+    WRITE_ONCE(instance->pid_ns, NULL);
+    put_pid_ns(ns);
+    static_branch_dec(&fake_rtc_views_enabled);
 }
 
-static int fake_rtc_proc_release(struct inode * inode, struct file * file) {
-    fake_rtc.device_proc_open--;
-    module_put(THIS_MODULE);
+/**
+ * @brief Bind instance to pid namespace, replacing previous binding of instance
+ * 
+ * Must be called with fake_rtc_instances_mutex held
+ * 
+ * @param instance - configfs instance
+ * @param ns - pid namespace
+ * @return int - status, -EBUSY if namespace is bound to another instance
+ */
+static int fake_rtc_instance_bind_locked(struct fake_rtc_instance *instance, struct pid_namespace *ns) {
+    struct fake_rtc_instance *bound;
+    int status;
+    hash_for_each_possible(fake_rtc_views, bound, view_node, (unsigned long)ns) {
+        if (bound->pid_ns == ns) {
+            return bound == instance ? 0 : -EBUSY;
+        }
+    }
+    if (instance->page == NULL) {
+        status = fake_rtc_instance_alloc_page(instance);
+        if (status) {
+            return status;
+        }
+    }
+    fake_rtc_instance_unbind_locked(instance);
+    instance->pid_ns = get_pid_ns(ns);
+    hash_add_rcu(fake_rtc_views, &instance->view_node, (unsigned long)ns);
+    static_branch_inc(&fake_rtc_views_enabled);
     return 0;
 }
 
-static ssize_t fake_rtc_proc_read(struct file * filp, char * buffer, size_t length, loff_t * offset) {
-    ssize_t bytes_read = 0;
-    if (offset != NULL) {
-        proc_msg_ptr += *offset;
+static ssize_t fake_rtc_instance_pid_ns_show(struct config_item *item, char *page) {
+    struct fake_rtc_instance *instance = to_fake_rtc_instance(item);
+    ssize_t length;
+    mutex_lock(&fake_rtc_instances_mutex);
+    if (instance->pid_ns == NULL) {
+        length = sprintf(page, "none\n");
+    } else {
+        length = sprintf(page, "pid:[%u]\n", instance->pid_ns->ns.inum);
     }
-    if (proc_msg_ptr - proc_msg > PROC_MSG_LEN) {
-        return 0;
+    mutex_unlock(&fake_rtc_instances_mutex);
+    return length;
+}
+
+/**
+ * @brief Write to pid_ns file of configfs instance
+ * 
+ * Writing PID binds instance to pid namespace of that process, PID is resolved in namespace of writer.
+ * Writing 0 removes binding
+ */
+static ssize_t fake_rtc_instance_pid_ns_store(struct config_item *item, const char *page, size_t count) {
+    struct fake_rtc_instance *instance = to_fake_rtc_instance(item);
+    struct pid *pid;
+    int nr;
+    int status = kstrtoint(page, 10, &nr);
+    if (status) {
+        return status;
+    }
+    if (nr < 0) {
+        return -EINVAL;
     }
-    while (*proc_msg_ptr && length--) {
-        put_user(*(proc_msg_ptr++), buffer++);
-        bytes_read++;
+    mutex_lock(&fake_rtc_instances_mutex);
+    if (nr == 0) {
+        fake_rtc_instance_unbind_locked(instance);
+    } else {
+        pid = find_get_pid(nr);
+        if (pid == NULL) {
+            status = -ESRCH;
+        } else {
+            status = fake_rtc_instance_bind_locked(instance, ns_of_pid(pid));
+            put_pid(pid);
+        }
     }
-    return bytes_read;
+    mutex_unlock(&fake_rtc_instances_mutex);
+    return status ? status : count;
 }
 
+CONFIGFS_ATTR_WO(fake_rtc_instance_, config);
+CONFIGFS_ATTR_RO(fake_rtc_instance_, status);
+CONFIGFS_ATTR_RO(fake_rtc_instance_, rtc);
+CONFIGFS_ATTR(fake_rtc_instance_, ptp);
+CONFIGFS_ATTR(fake_rtc_instance_, pid_ns);
+
+static struct configfs_attribute *fake_rtc_instance_attrs[] = {
+    &fake_rtc_instance_attr_config,
+    &fake_rtc_instance_attr_status,
+    &fake_rtc_instance_attr_rtc,
+    &fake_rtc_instance_attr_ptp,
+    &fake_rtc_instance_attr_pid_ns,
+    NULL
+};
+
 /**
- * @brief write function for /proc interface
+ * @brief Destroy configfs instance when its last reference is dropped
  * 
- * It consumes 1 char from user input. It should be a digit from 0 to 3 to change mode
- * Otherways this function does nothing
+ * rmdir drops reference of directory, but open attribute files and files of /dev/fake_rtc
+ * keep instance until they are closed
  * 
- * @param filp 
- * @param buff 
- * @param len 
- * @param off 
- * @return ssize_t 
+ * @param item - item of instance
+ */
+static void fake_rtc_instance_release(struct config_item *item) {
+    struct fake_rtc_instance *instance = to_fake_rtc_instance(item);
+    mutex_lock(&fake_rtc_instances_mutex);
+    fake_rtc_instance_unbind_locked(instance);
+    mutex_unlock(&fake_rtc_instances_mutex);
+    fake_rtc_instance_unregister(instance);
+    fake_rtc_instance_free(instance);
+}
+
+static struct configfs_item_operations fake_rtc_instance_item_ops = {
+    .release = fake_rtc_instance_release
+};
+
+static const struct config_item_type fake_rtc_instance_type = {
+    .ct_item_ops = &fake_rtc_instance_item_ops,
+    .ct_attrs = fake_rtc_instance_attrs,
+    .ct_owner = THIS_MODULE
+};
+
+/**
+ * @brief mkdir in configfs: create instance with its own RTC device
+ * 
+ * Name of directory becomes name of PTP clock of instance
+ * 
+ * @param group - fake_rtc group of configfs
+ * @param name - name of directory
+ * @return struct config_item* - item of new instance or error pointer
  */
-static ssize_t fake_rtc_proc_write(struct file *filp, const char *buff, size_t len, loff_t * off) {
-    static char mode_char;
-    if (len == 0 || *off > 0) {
-        dev_warn(&(fake_rtc.pdev->dev), "This module expects just one digit without offset in proc inputs");
-        return len;
+static struct config_item *fake_rtc_make_item(struct config_group *group, const char *name) {
+    struct fake_rtc_instance *instance = fake_rtc_instance_alloc();
+    int status;
+    if (instance == NULL) {
+        return ERR_PTR(-ENOMEM);
     }
-    get_user(mode_char, buff);
-    if (mode_char < '0' || mode_char > '3') {
-        dev_warn(&(fake_rtc.pdev->dev), "This module expects first character of proc input to be digit from 0 to 3");
-        return len;
+    status = fake_rtc_instance_register(instance, PLATFORM_DEVID_AUTO);
+    if (status) {
+        fake_rtc_instance_free(instance);
+        return ERR_PTR(status);
     }
-    mode = mode_char - '0';
-    return len;
+    strscpy(instance->ptp_info.name, name, sizeof(instance->ptp_info.name));
+    config_item_init_type_name(&instance->item, name, &fake_rtc_instance_type);
+    return &instance->item;
 }
 
+static struct configfs_group_operations fake_rtc_group_ops = {
+    .make_item = fake_rtc_make_item
+};
 
-static struct file_operations fake_rtc_proc_ops = {
-    .open = fake_rtc_proc_open,
-    .release = fake_rtc_proc_release,
-    .read = fake_rtc_proc_read,
-    .write = fake_rtc_proc_write
+static const struct config_item_type fake_rtc_subsys_type = {
+    .ct_group_ops = &fake_rtc_group_ops,
+    .ct_owner = THIS_MODULE
 };
 
+static struct configfs_subsystem fake_rtc_subsys = {
+    .su_group = {
+        .cg_item = {
+            .ci_namebuf = FAKE_RTC_DEVICE_NAME,
+            .ci_type = &fake_rtc_subsys_type
+        }
+    }
+};
+
+static bool fake_rtc_configfs_registered;
+
+/**
+ * @brief Register /sys/kernel/config/fake_rtc
+ * 
+ * Module works without configfs with default instance only
+ */
+static void fake_rtc_configfs_init(void) {
+    config_group_init(&fake_rtc_subsys.su_group);
+    mutex_init(&fake_rtc_subsys.su_mutex);
+    if (configfs_register_subsystem(&fake_rtc_subsys)) {
+        pr_warn(DEVICE_NAME ": configfs is not available, instances can't be created");
+        return;
+    }
+    fake_rtc_configfs_registered = true;
+}
+
+/**
+ * @brief Unregister configfs subsystem
+ * 
+ * configfs holds reference to module while any instance exists, so there are no instances here
+ */
+static void fake_rtc_configfs_exit(void) {
+    if (fake_rtc_configfs_registered) {
+        configfs_unregister_subsystem(&fake_rtc_subsys);
+    }
+}
+
+#else
+
+static void fake_rtc_configfs_init(void) {
+}
+
+static void fake_rtc_configfs_exit(void) {
+}
+
+#endif
+
 /**
  * @brief cleanup routine
  * 
  * On module detach we need to free all allocated resources and /proc entry 
  */
 void fake_rtc_cleanup(void) {
-    platform_device_del(fake_rtc.pdev);
-    proc_remove(fake_rtc.proc_entry);
+    fake_rtc_configfs_exit();
+    debugfs_remove_recursive(fake_rtc_debugfs_dir);
+    proc_remove(fake_rtc_proc_entry);
+    misc_deregister(&fake_rtc_misc_device);
+    fake_rtc_instance_unregister(fake_rtc_default);
+    fake_rtc_instance_free(fake_rtc_default);
+    fake_rtc_default = NULL;
+    rcu_barrier();
+    kmem_cache_destroy(fake_rtc_instance_cache);
 }
 
 /**
  * @brief initialisation routine
  * 
- * Platform device and rtc device are being registered here. 
- * Also this function creates /proc entry and synchronizes time
+ * Default instance with its platform device, rtc device, PTP clock and /dev/fake_rtc is being registered here.
+ * Also this function creates /proc, debugfs and configfs entries
  * 
  * @return int - status
  */
 int fake_rtc_init(void) {
+    struct fake_rtc_instance *instance;
     struct device* associated_device;
-    fake_rtc.pdev = platform_device_register_simple(DEVICE_NAME, -1, NULL, 0);
-    associated_device = &(fake_rtc.pdev->dev);
-    fake_rtc.rtc_dev = devm_rtc_device_register(associated_device, DEVICE_NAME, &fake_rtc_operations, THIS_MODULE);
+    int status;
+    fake_rtc_instance_cache = KMEM_CACHE(fake_rtc_instance, SLAB_HWCACHE_ALIGN);
+    if (fake_rtc_instance_cache == NULL) {
+        return -ENOMEM;
+    }
+    if (!fake_rtc_random_seed_given) {
+        set_random_seed(get_random_u64());
+    }
+    instance = fake_rtc_instance_alloc();
+    if (instance == NULL) {
+        status = -ENOMEM;
+        goto destroy_cache;
+    }
+    status = fake_rtc_instance_alloc_page(instance);
+    if (status) {
+        goto free_instance;
+    }
 
-    fake_rtc.proc_entry = proc_create("FakeRTC", 0666, NULL, &fake_rtc_proc_ops);
-    if (fake_rtc.proc_entry == NULL) {
-        dev_err(associated_device, "Proc entry creation failed");
+    status = fake_rtc_instance_register(instance, -1);
+    if (status) {
+        goto free_instance;
+    }
+    associated_device = &(instance->pdev->dev);
+    if (fake_rtc_instance_register_ptp(instance)) {
+        dev_warn(associated_device, "PTP clock is not available, nanosecond access to fake time is disabled");
+    } else {
+        dev_info(associated_device, "Fake time is available as PTP clock ptp%d", ptp_clock_index(instance->ptp_clock));
     }
-    fake_rtc.device_proc_open = 0;
+    fake_rtc_default = instance;
 
-    fake_rtc.read_counter = 0;
-    fake_rtc.set_counter = 0;
+    status = misc_register(&fake_rtc_misc_device);
+    if (status) {
+        dev_err(associated_device, "Registration of /dev/%s failed", FAKE_RTC_DEVICE_NAME);
+        goto unregister_instance;
+    }
 
-    synchronize_boot_time();
-    synchronize_real_time();
+    fake_rtc_proc_entry = proc_create_data("FakeRTC", 0666, NULL, &fake_rtc_proc_ops, instance);
+    if (fake_rtc_proc_entry == NULL) {
+        dev_err(associated_device, "Proc entry creation failed");
+    }
+    fake_rtc_debugfs_init();
+    fake_rtc_configfs_init();
 
     return 0;
+
+unregister_instance:
+    fake_rtc_default = NULL;
+    fake_rtc_instance_unregister(instance);
+free_instance:
+    fake_rtc_instance_free(instance);
+    rcu_barrier();
+destroy_cache:
+    kmem_cache_destroy(fake_rtc_instance_cache);
+    return status;
 }
 
 module_init(fake_rtc_init);
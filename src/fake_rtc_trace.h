@@ -0,0 +1,144 @@
+/**
+ * Tracepoints of fake_rtc module, available in ftrace, perf and trace-cmd in events/fake_rtc
+ *
+ * Included by fake_rtc.c after definition of enum fake_rtc_mode. Disabled tracepoints cost only a patched out jump
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fake_rtc
+
+#if !defined(FAKE_RTC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define FAKE_RTC_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_DEFINE_ENUM(REAL);
+TRACE_DEFINE_ENUM(RANDOM);
+TRACE_DEFINE_ENUM(ACCELERATED);
+TRACE_DEFINE_ENUM(SLOWED);
+TRACE_DEFINE_ENUM(SCHEDULE);
+TRACE_DEFINE_ENUM(TRACE);
+
+#define show_fake_rtc_mode(mode) __print_symbolic(mode, \
+    { REAL, "real" }, \
+    { RANDOM, "random" }, \
+    { ACCELERATED, "accel" }, \
+    { SLOWED, "slow" }, \
+    { SCHEDULE, "schedule" }, \
+    { TRACE, "trace" })
+
+/**
+ * Fake time served to any client: RTC, PTP, /dev/fake_rtc or /proc
+ *
+ * @boot_time - CLOCK_MONOTONIC which fake time was calculated for
+ * @fake_time - served time in nanoseconds from January 1st 1970, including jitter
+ * @mode - mode of anchor used for calculation
+ * @saturated - time was saturated at range limits
+ */
+TRACE_EVENT(fake_rtc_read,
+    TP_PROTO(s64 boot_time, s64 fake_time, int mode, bool saturated),
+    TP_ARGS(boot_time, fake_time, mode, saturated),
+    TP_STRUCT__entry(
+        __field(s64, boot_time)
+        __field(s64, fake_time)
+        __field(int, mode)
+        __field(bool, saturated)
+    ),
+    TP_fast_assign(
+        __entry->boot_time = boot_time;
+        __entry->fake_time = fake_time;
+        __entry->mode = mode;
+        __entry->saturated = saturated;
+    ),
+    TP_printk("boot_time=%lld fake_time=%lld mode=%s%s", __entry->boot_time, __entry->fake_time,
+        show_fake_rtc_mode(__entry->mode), __entry->saturated ? " saturated" : "")
+);
+
+/**
+ * Time set through RTC, PTP or sync command
+ *
+ * @boot_time - CLOCK_MONOTONIC of new synchronization point
+ * @fake_time - new time in nanoseconds from January 1st 1970
+ */
+TRACE_EVENT(fake_rtc_set,
+    TP_PROTO(s64 boot_time, s64 fake_time),
+    TP_ARGS(boot_time, fake_time),
+    TP_STRUCT__entry(
+        __field(s64, boot_time)
+        __field(s64, fake_time)
+    ),
+    TP_fast_assign(
+        __entry->boot_time = boot_time;
+        __entry->fake_time = fake_time;
+    ),
+    TP_printk("boot_time=%lld fake_time=%lld", __entry->boot_time, __entry->fake_time)
+);
+
+/**
+ * Transform published after any change of anchor
+ *
+ * Fake time is real_time + (CLOCK_MONOTONIC - boot_time) * mult / 2^shift in linear modes
+ */
+TRACE_EVENT(fake_rtc_transform,
+    TP_PROTO(int mode, s64 mult, u32 shift, s64 real_time, s64 boot_time),
+    TP_ARGS(mode, mult, shift, real_time, boot_time),
+    TP_STRUCT__entry(
+        __field(int, mode)
+        __field(s64, mult)
+        __field(u32, shift)
+        __field(s64, real_time)
+        __field(s64, boot_time)
+    ),
+    TP_fast_assign(
+        __entry->mode = mode;
+        __entry->mult = mult;
+        __entry->shift = shift;
+        __entry->real_time = real_time;
+        __entry->boot_time = boot_time;
+    ),
+    TP_printk("mode=%s mult=%lld shift=%u real_time=%lld boot_time=%lld", show_fake_rtc_mode(__entry->mode),
+        __entry->mult, __entry->shift, __entry->real_time, __entry->boot_time)
+);
+
+TRACE_EVENT(fake_rtc_mode_change,
+    TP_PROTO(int old_mode, int new_mode),
+    TP_ARGS(old_mode, new_mode),
+    TP_STRUCT__entry(
+        __field(int, old_mode)
+        __field(int, new_mode)
+    ),
+    TP_fast_assign(
+        __entry->old_mode = old_mode;
+        __entry->new_mode = new_mode;
+    ),
+    TP_printk("%s -> %s", show_fake_rtc_mode(__entry->old_mode), show_fake_rtc_mode(__entry->new_mode))
+);
+
+/**
+ * Write of commands to /proc/FakeRTC or to config file of configfs instance
+ *
+ * @commands - written commands
+ * @status - result of write, negative error code if configuration was not changed
+ */
+TRACE_EVENT(fake_rtc_config,
+    TP_PROTO(const char *commands, int status),
+    TP_ARGS(commands, status),
+    TP_STRUCT__entry(
+        __string(commands, commands)
+        __field(int, status)
+    ),
+    TP_fast_assign(
+        __assign_str(commands, commands);
+        __entry->status = status;
+    ),
+    TP_printk("commands=\"%s\" status=%d", __get_str(commands), __entry->status)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fake_rtc_trace
+
+#include <trace/define_trace.h>
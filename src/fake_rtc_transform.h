@@ -0,0 +1,487 @@
+#ifndef FAKE_RTC_TRANSFORM_H
+#define FAKE_RTC_TRANSFORM_H
+
+/**
+ * Time transform of fake_rtc shared by module, client library and userspace tests
+ *
+ * Fake time of every mode is a saturating fixed point function of nanoseconds elapsed from synchronization point:
+ * linear for real, random, accelerated and slowed modes, piecewise linear for schedule and real time plus
+ * interpolated offset for trace. Functions here use only integer arithmetic, so the same code is compiled into
+ * module and into userspace. They are static inline, so reading time in module stays one inlined multiplication
+ */
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/types.h>
+
+#ifndef CONFIG_ARCH_SUPPORTS_INT128
+#define FAKE_RTC_NO_INT128
+#endif
+#else
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef uint32_t u32;
+typedef int32_t s32;
+typedef uint64_t u64;
+typedef int64_t s64;
+typedef s64 ktime_t;
+
+#define KTIME_MAX INT64_MAX
+#define U64_MAX UINT64_MAX
+
+static inline int fls64(u64 x) {
+    return x == 0 ? 0 : 64 - __builtin_clzll(x);
+}
+
+static inline u64 div64_u64_rem(u64 dividend, u64 divisor, u64 *remainder) {
+    *remainder = dividend % divisor;
+    return dividend / divisor;
+}
+#endif
+
+/**
+ * Range of fake time in nanoseconds from January 1st 1970
+ * Calculated time never leaves this range, it is saturated at its limits
+ */
+#define MIN_FAKE_TIME 0
+#define MAX_FAKE_TIME KTIME_MAX
+
+/**
+ * @brief Segment of schedule: part of timeline with constant rate
+ *
+ * Start of segment is precomputed when schedule is uploaded, so fake time of any moment
+ * is found without walking through previous segments
+ *
+ * @real_start - nanoseconds from synchronization point when segment starts
+ * @fake_start - fake time at start of segment relative to synchronized real time, includes jumps
+ * @mult - fixed point rate of segment
+ * @shift - number of fractional bits in mult
+ * @inverse_mult - fixed point value of 1 / rate
+ * @inverse_shift - number of fractional bits in inverse_mult
+ */
+struct fake_rtc_segment {
+    u64 real_start;
+    s64 fake_start;
+    s64 mult;
+    u32 shift;
+    s64 inverse_mult;
+    u32 inverse_shift;
+};
+
+/**
+ * @brief Recorded offsets of trace mode
+ *
+ * Offsets are relative to the first sample, so fake time doesn't jump when trace starts. After the last sample its offset stays
+ *
+ * @interval - real nanoseconds between samples
+ * @inverse_mult - fixed point value of 1 / interval, used to find index of sample without division
+ * @inverse_shift - number of fractional bits in inverse_mult, at least 32
+ * @count - number of samples, at least one
+ * @offsets - offset of fake time from real one at every sample in nanoseconds
+ */
+struct fake_rtc_samples {
+    u64 interval;
+    s64 inverse_mult;
+    u32 inverse_shift;
+    u64 count;
+    const s64 *offsets;
+};
+
+/**
+ * @brief Convert rate to fixed point multiplier
+ *
+ * Rate is represented as mult / 2^shift. Shift is chosen as big as possible to keep precision,
+ * so multiplier uses all 63 bits available. Division takes place here, on configuration path,
+ * so reading time needs only multiplication and shift
+ *
+ * @param num - numerator of rate
+ * @param den - denominator of rate, less than 2^63
+ * @param mult - where to store multiplier
+ * @param shift - where to store shift
+ */
+static inline void fake_rtc_rate_to_fixed(u64 num, u64 den, s64 *mult, u32 *shift) {
+    u64 remainder;
+    u64 quotient = div64_u64_rem(num, den, &remainder);
+    u64 fixed;
+    int bit;
+    *shift = 63 - fls64(quotient);
+    fixed = quotient << *shift;
+    for (bit = *shift - 1; bit >= 0; bit--) {
+        remainder <<= 1;
+        if (remainder >= den) {
+            fixed |= 1ULL << bit;
+            remainder -= den;
+        }
+    }
+    *mult = fixed;
+}
+
+/**
+ * @brief Multiply by fixed point rate using 128-bit intermediate result
+ *
+ * Unlike mul_u64_u64_shr it doesn't wrap around: result which doesn't fit in 64 bits is saturated.
+ * Without 128-bit integers (or with FAKE_RTC_NO_INT128 defined) product is assembled from 32-bit halves
+ *
+ * @param a - value to multiply
+ * @param mult - fixed point multiplier
+ * @param shift - number of fractional bits in mult
+ * @return u64 - (a * mult) >> shift or U64_MAX if it doesn't fit
+ */
+static inline u64 mul_u64_u64_shr_sat(u64 a, u64 mult, u32 shift) {
+#if defined(__SIZEOF_INT128__) && !defined(FAKE_RTC_NO_INT128)
+    unsigned __int128 product = ((unsigned __int128)a * mult) >> shift;
+    return product > U64_MAX ? U64_MAX : (u64)product;
+#else
+    u64 low = (u64)(u32)a * (u32)mult;
+    u64 middle_first = (a >> 32) * (u32)mult;
+    u64 middle_second = (u64)(u32)a * (mult >> 32);
+    u64 high = (a >> 32) * (mult >> 32);
+    u64 middle = (low >> 32) + (u32)middle_first + (u32)middle_second;
+    high += (middle_first >> 32) + (middle_second >> 32) + (middle >> 32);
+    low = (middle << 32) | (u32)low;
+    if (shift == 0) {
+        return high ? U64_MAX : low;
+    }
+    if (high >> shift) {
+        return U64_MAX;
+    }
+    return (high << (64 - shift)) | (low >> shift);
+#endif
+}
+
+/**
+ * @brief Add signed value to fake time, saturating at range limits
+ *
+ * @param time - time from January 1st 1970
+ * @param delta - nanoseconds to add
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static inline ktime_t fake_rtc_add_sat(ktime_t time, s64 delta, bool *saturated) {
+    *saturated = true;
+    if (delta > MAX_FAKE_TIME - time) {
+        return MAX_FAKE_TIME;
+    }
+    if (delta < MIN_FAKE_TIME - time) {
+        return MIN_FAKE_TIME;
+    }
+    *saturated = false;
+    return time + delta;
+}
+
+/**
+ * @brief Linear function of elapsed time, used by all modes and schedule segments
+ *
+ * Result is saturated at range limits instead of wrapping around,
+ * so even huge rates give correct time until the end of range and the last representable time after it
+ *
+ * @param base - fake time at start of measurement
+ * @param nanoseconds_difference - nanoseconds from start of measurement
+ * @param mult - fixed point rate, negative for time going backwards
+ * @param shift - number of fractional bits in mult
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static inline ktime_t fake_rtc_scale(ktime_t base, u64 nanoseconds_difference, s64 mult, u32 shift, bool *saturated) {
+    u64 scaled = mul_u64_u64_shr_sat(nanoseconds_difference, mult < 0 ? -(u64)mult : (u64)mult, shift);
+    *saturated = false;
+    if (mult < 0) {
+        if (scaled > (u64)(base - MIN_FAKE_TIME)) {
+            *saturated = true;
+            return MIN_FAKE_TIME;
+        }
+        return base - scaled;
+    }
+    if (scaled > (u64)(MAX_FAKE_TIME - base)) {
+        *saturated = true;
+        return MAX_FAKE_TIME;
+    }
+    return base + scaled;
+}
+
+/**
+ * @brief Inverse of fake_rtc_scale for positive rate
+ *
+ * @param base - fake time at start of measurement
+ * @param boot_time - moment (by CLOCK_MONOTONIC) of start of measurement
+ * @param fake_time - time from January 1st 1970
+ * @param inverse_mult - fixed point value of 1 / rate
+ * @param inverse_shift - number of fractional bits in inverse_mult
+ * @return ktime_t - moment (by CLOCK_MONOTONIC) when fake time reaches fake_time, boot_time if it was reached before
+ *                   start of measurement. Result is within a nanosecond of exact inverse, but both multipliers are
+ *                   rounded down, so fake_rtc_scale may reach fake_time a little later. Callers check fake time again
+ *                   when they wake up
+ */
+static inline ktime_t fake_rtc_inverse_scale(ktime_t base, ktime_t boot_time, ktime_t fake_time, s64 inverse_mult, u32 inverse_shift) {
+    u64 scaled;
+    if (fake_time <= base) {
+        return boot_time;
+    }
+    scaled = mul_u64_u64_shr_sat(fake_time - base, inverse_mult, inverse_shift);
+    /* Inverse multiplier is rounded down, so one more nanosecond compensates it */
+    if (scaled >= (u64)(KTIME_MAX - boot_time)) {
+        return KTIME_MAX;
+    }
+    return boot_time + scaled + 1;
+}
+
+/**
+ * @brief Seed state of xoshiro128** generator of random mode
+ *
+ * State is expanded from seed and number of stream with splitmix64, so one seed gives independent
+ * reproducible streams
+ *
+ * @param state - state of generator
+ * @param seed - seed of random mode
+ * @param stream - number of stream, CPU number in module
+ */
+static inline void fake_rtc_random_init(u32 state[4], u64 seed, u32 stream) {
+    u64 x = seed ^ ((u64)stream << 32);
+    u64 words[2];
+    int i;
+    for (i = 0; i < 2; i++) {
+        u64 z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        words[i] = z ^ (z >> 31);
+    }
+    state[0] = words[0];
+    state[1] = words[0] >> 32;
+    state[2] = words[1];
+    state[3] = words[1] >> 32;
+}
+
+/**
+ * @brief Next value of xoshiro128** generator of random mode
+ *
+ * @param state - state of generator, advanced by one step
+ * @return u32 - uniformly distributed random value
+ */
+static inline u32 fake_rtc_random_next(u32 state[4]) {
+    u32 product = state[1] * 5;
+    u32 result = ((product << 7) | (product >> 25)) * 9;
+    u32 t = state[1] << 9;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = (state[3] << 11) | (state[3] >> 21);
+    return result;
+}
+
+/**
+ * @brief Coefficient of random mode
+ *
+ * Coefficient is integer from random_min to random_min + random_range - 1, so it is used as multiplier with zero shift.
+ * Random value is mapped to this range by multiplication and shift, without division
+ *
+ * @param random - uniformly distributed random value
+ * @param random_min - smallest coefficient
+ * @param random_range - number of possible coefficients, from 1 to 2^32
+ * @return s64 - coefficient
+ */
+static inline s64 fake_rtc_random_coefficient(u32 random, s32 random_min, u64 random_range) {
+    return random_min + (s64)(((u64)random * random_range) >> 32);
+}
+
+/**
+ * @brief Find segment of schedule active at given moment
+ *
+ * Binary search over precomputed starts of segments, so cost doesn't depend on length of schedule much
+ *
+ * @param segments - segments of schedule sorted by real_start, the first one starts at 0
+ * @param count - number of segments, at least one
+ * @param nanoseconds_difference - nanoseconds from synchronization point
+ * @return unsigned int - index of segment
+ */
+static inline unsigned int fake_rtc_find_segment(const struct fake_rtc_segment *segments, unsigned int count,
+        u64 nanoseconds_difference) {
+    unsigned int low = 0;
+    unsigned int high = count;
+    while (high - low > 1) {
+        unsigned int middle = low + (high - low) / 2;
+        if (segments[middle].real_start <= nanoseconds_difference) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Fake time inside given segment of schedule
+ *
+ * @param real_time - fake time at synchronization point where schedule starts
+ * @param segment - segment containing measured moment
+ * @param nanoseconds_difference - nanoseconds from synchronization point
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static inline ktime_t fake_rtc_segment_time(ktime_t real_time, const struct fake_rtc_segment *segment,
+        u64 nanoseconds_difference, bool *saturated) {
+    bool base_saturated;
+    ktime_t base = fake_rtc_add_sat(real_time, segment->fake_start, &base_saturated);
+    ktime_t time = fake_rtc_scale(base, nanoseconds_difference - segment->real_start, segment->mult, segment->shift, saturated);
+    *saturated |= base_saturated;
+    return time;
+}
+
+/**
+ * @brief Fake time at given moment in schedule mode
+ *
+ * @param real_time - fake time at synchronization point where schedule starts
+ * @param segments - segments of schedule
+ * @param count - number of segments
+ * @param nanoseconds_difference - nanoseconds from synchronization point
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static inline ktime_t fake_rtc_schedule_time(ktime_t real_time, const struct fake_rtc_segment *segments, unsigned int count,
+        u64 nanoseconds_difference, bool *saturated) {
+    return fake_rtc_segment_time(real_time, &segments[fake_rtc_find_segment(segments, count, nanoseconds_difference)],
+        nanoseconds_difference, saturated);
+}
+
+/**
+ * @brief Find moment when fake time of schedule reaches given value
+ *
+ * Jumps of schedule can move fake time backwards, so search starts from segment active now
+ * and takes the first segment which reaches fake_time before its end
+ *
+ * @param real_time - fake time at synchronization point where schedule starts
+ * @param boot_time - moment (by CLOCK_MONOTONIC) of synchronization point
+ * @param segments - segments of schedule
+ * @param count - number of segments
+ * @param fake_time - time from January 1st 1970
+ * @param now - current moment (by CLOCK_MONOTONIC), not before boot_time
+ * @return ktime_t - moment (by CLOCK_MONOTONIC) when fake time is not less than fake_time,
+ *                   not later than now if it is already reached
+ */
+static inline ktime_t fake_rtc_schedule_deadline(ktime_t real_time, ktime_t boot_time, const struct fake_rtc_segment *segments,
+        unsigned int count, ktime_t fake_time, ktime_t now) {
+    const struct fake_rtc_segment *segment;
+    unsigned int index = fake_rtc_find_segment(segments, count, now - boot_time);
+    bool saturated;
+    for (; index + 1 < count; index++) {
+        u64 end = segments[index + 1].real_start;
+        if (fake_time <= fake_rtc_segment_time(real_time, &segments[index], end, &saturated)) {
+            break;
+        }
+    }
+    segment = &segments[index];
+    return fake_rtc_inverse_scale(fake_rtc_add_sat(real_time, segment->fake_start, &saturated),
+        boot_time + segment->real_start, fake_time, segment->inverse_mult, segment->inverse_shift);
+}
+
+/**
+ * @brief Offset of trace at given moment
+ *
+ * Index of sample is found by multiplication with inverse of interval. It is rounded down at most by one,
+ * so it is corrected with one comparison. Offset is interpolated linearly between neighbouring samples
+ *
+ * @param samples - offsets of trace mode
+ * @param nanoseconds_difference - nanoseconds from synchronization point
+ * @return s64 - offset of fake time from real one in nanoseconds
+ */
+static inline s64 fake_rtc_trace_offset(const struct fake_rtc_samples *samples, u64 nanoseconds_difference) {
+    u64 index = mul_u64_u64_shr_sat(nanoseconds_difference, samples->inverse_mult, samples->inverse_shift);
+    u64 remainder;
+    u64 fraction;
+    u64 interpolated;
+    s64 delta;
+    if (index >= samples->count - 1) {
+        return samples->offsets[samples->count - 1];
+    }
+    remainder = nanoseconds_difference - index * samples->interval;
+    if (remainder >= samples->interval) {
+        index++;
+        remainder -= samples->interval;
+        if (index == samples->count - 1) {
+            return samples->offsets[index];
+        }
+    }
+    /* remainder / interval with 32 fractional bits */
+    fraction = mul_u64_u64_shr_sat(remainder, samples->inverse_mult, samples->inverse_shift - 32);
+    delta = samples->offsets[index + 1] - samples->offsets[index];
+    interpolated = mul_u64_u64_shr_sat(delta < 0 ? -(u64)delta : (u64)delta, fraction, 32);
+    return samples->offsets[index] + (delta < 0 ? -(s64)interpolated : (s64)interpolated);
+}
+
+/**
+ * @brief Fake time at given moment in trace mode
+ *
+ * Offset and elapsed time are summed before they are added to real time, so negative offset near
+ * the beginning of range is not lost to saturation of intermediate result
+ *
+ * @param real_time - fake time at synchronization point where trace starts
+ * @param samples - offsets of trace mode
+ * @param nanoseconds_difference - nanoseconds from synchronization point
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static inline ktime_t fake_rtc_trace_time(ktime_t real_time, const struct fake_rtc_samples *samples,
+        u64 nanoseconds_difference, bool *saturated) {
+    s64 offset = fake_rtc_trace_offset(samples, nanoseconds_difference);
+    s64 elapsed = nanoseconds_difference > KTIME_MAX ? KTIME_MAX : (s64)nanoseconds_difference;
+    if (offset > 0 && elapsed > KTIME_MAX - offset) {
+        *saturated = true;
+        return MAX_FAKE_TIME;
+    }
+    return fake_rtc_add_sat(real_time, elapsed + offset, saturated);
+}
+
+/**
+ * @brief Fake time of private timeline layered on fake time of device
+ *
+ * Timeline shows start when device shows base_time and runs with its own rate relative to device.
+ * If device time is set back before base_time, timeline goes back proportionally
+ *
+ * @param start - time of timeline at anchor
+ * @param base_time - fake time of device at anchor
+ * @param device_time - current fake time of device
+ * @param mult - fixed point rate of timeline relative to device, positive
+ * @param shift - number of fractional bits in mult
+ * @param saturated - set to true if result was saturated, false otherwise
+ * @return ktime_t - time from January 1st 1970
+ */
+static inline ktime_t fake_rtc_timeline_time(ktime_t start, ktime_t base_time, ktime_t device_time, s64 mult, u32 shift,
+        bool *saturated) {
+    if (device_time >= base_time) {
+        return fake_rtc_scale(start, (u64)(device_time - base_time), mult, shift, saturated);
+    }
+    return fake_rtc_scale(start, (u64)(base_time - device_time), -mult, shift, saturated);
+}
+
+/**
+ * @brief Count periodic interrupts due at current fake time and move next interrupt past it
+ *
+ * Timer fires a little after the deadline, so fake_now is usually just past next. All periods passed since
+ * previous call are reported at once. If fake time was moved backwards by more than a period,
+ * next interrupt is rescheduled one period after fake_now
+ *
+ * @param next - fake time of next interrupt, updated
+ * @param fake_now - current fake time
+ * @param period - fake nanoseconds between interrupts, not zero
+ * @return u64 - number of interrupts due
+ */
+static inline u64 fake_rtc_periodic_ticks(ktime_t *next, ktime_t fake_now, u64 period) {
+    u64 remainder;
+    u64 ticks;
+    if (*next - fake_now > (s64)period) {
+        *next = fake_now + period;
+        return 0;
+    }
+    if (fake_now < *next) {
+        return 0;
+    }
+    ticks = div64_u64_rem(fake_now - *next, period, &remainder) + 1;
+    *next += ticks * period;
+    return ticks;
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef FAKE_RTC_UAPI_H
+#define FAKE_RTC_UAPI_H
+
+/**
+ * Interface of /dev/fake_rtc shared by module and userspace clients
+ */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define FAKE_RTC_DEVICE_NAME "fake_rtc"
+
+#define FAKE_RTC_PAGE_VERSION 1
+
+/**
+ * Page is valid when fake time is linear function of CLOCK_MONOTONIC and jitter is disabled.
+ * Otherwise (random, schedule and trace modes or enabled jitter) client has to ask module via FAKE_RTC_GET_TIME
+ */
+#define FAKE_RTC_PAGE_VALID (1 << 0)
+
+/**
+ * @brief Read-only page with current transform, mapped by clients of /dev/fake_rtc
+ *
+ * Fake time is real_time + (CLOCK_MONOTONIC - boot_time) * mult / 2^shift, saturated at [0, INT64_MAX]
+ * Negative mult means time goes backwards
+ *
+ * @sequence - odd while module updates the page. Client has to retry if it was odd or changed during read
+ * @version - FAKE_RTC_PAGE_VERSION
+ * @flags - FAKE_RTC_PAGE_* flags
+ * @shift - number of fractional bits in mult
+ * @mult - fixed point rate
+ * @real_time - fake time at synchronization point in nanoseconds from January 1st 1970
+ * @boot_time - CLOCK_MONOTONIC at synchronization point in nanoseconds
+ */
+struct fake_rtc_page {
+    __u32 sequence;
+    __u32 version;
+    __u32 flags;
+    __u32 shift;
+    __s64 mult;
+    __s64 real_time;
+    __s64 boot_time;
+};
+
+/**
+ * Trace replayed in trace mode is loaded with request_firmware, so its file has to be in firmware search path
+ * (for example /lib/firmware). File is header followed by count - 1 little endian __s32 deltas:
+ * offset of sample i is sum of first i deltas, offset of the first sample is 0
+ */
+#define FAKE_RTC_TRACE_MAGIC 0x54525446 /* "FTRT" */
+#define FAKE_RTC_TRACE_VERSION 1
+
+/**
+ * @brief Header of trace file, all fields are little endian
+ *
+ * @magic - FAKE_RTC_TRACE_MAGIC
+ * @version - FAKE_RTC_TRACE_VERSION
+ * @interval - real nanoseconds between samples
+ * @count - number of samples, at least one
+ */
+struct fake_rtc_trace_header {
+    __le32 magic;
+    __le32 version;
+    __le64 interval;
+    __le64 count;
+};
+
+#define FAKE_RTC_IOCTL_BASE 'F'
+
+/**
+ * Get current fake time in nanoseconds from January 1st 1970
+ */
+#define FAKE_RTC_GET_TIME _IOR(FAKE_RTC_IOCTL_BASE, 0x01, __s64)
+
+/**
+ * Get number of periodic interrupts of this open which were coalesced because reader was late
+ * Periodic interrupts are controlled with RTC_IRQP_SET, RTC_IRQP_READ, RTC_PIE_ON and RTC_PIE_OFF from <linux/rtc.h>
+ * and read with read() like on /dev/rtcN, but their frequency is in fake time
+ */
+#define FAKE_RTC_PIE_MISSED _IOR(FAKE_RTC_IOCTL_BASE, 0x02, __u64)
+
+/**
+ * @brief Private timeline of one open of /dev/fake_rtc, argument of FAKE_RTC_SET_TIMELINE
+ *
+ * After the ioctl, FAKE_RTC_GET_TIME of this open returns base_time + offset + (T - base_time) * num / den,
+ * where T is fake time of device. Other opens are not affected. Mapped page still describes time of device,
+ * so client calculates timeline from it (see fake_rtc_timeline_time in fake_rtc_transform.h)
+ *
+ * @offset - nanoseconds added to fake time of device at moment of ioctl
+ * @num - numerator of rate relative to fake time of device, not zero
+ * @den - denominator of rate, not zero
+ * @base_time - set by module: fake time of device at moment of ioctl
+ */
+struct fake_rtc_timeline {
+    __s64 offset;
+    __u32 num;
+    __u32 den;
+    __s64 base_time;
+};
+
+/**
+ * Give this open its own timeline layered on fake time of device, replacing previous one
+ */
+#define FAKE_RTC_SET_TIMELINE _IOWR(FAKE_RTC_IOCTL_BASE, 0x03, struct fake_rtc_timeline)
+
+/**
+ * Return this open to fake time of device
+ */
+#define FAKE_RTC_CLEAR_TIMELINE _IO(FAKE_RTC_IOCTL_BASE, 0x04)
+
+/**
+ * @brief One sample of FAKE_RTC_SAMPLE
+ *
+ * @boot_time - moment by CLOCK_MONOTONIC in nanoseconds
+ * @fake_time - fake time of this open at that moment in nanoseconds from January 1st 1970
+ */
+struct fake_rtc_sample {
+    __s64 boot_time;
+    __s64 fake_time;
+};
+
+#define FAKE_RTC_MAX_SAMPLES 65536
+
+/**
+ * @brief Argument of FAKE_RTC_SAMPLE
+ *
+ * With zero spacing every sample is taken at the moment it is calculated, like consecutive FAKE_RTC_GET_TIME.
+ * With positive spacing samples are calculated for moments now, now + spacing, now + 2 * spacing, ... without
+ * waiting, so moments in future are predicted with current configuration
+ *
+ * @samples - user pointer to array of count struct fake_rtc_sample
+ * @count - number of samples, from 1 to FAKE_RTC_MAX_SAMPLES
+ * @flags - must be zero
+ * @spacing - nanoseconds of CLOCK_MONOTONIC between samples, zero or positive
+ */
+struct fake_rtc_sample_request {
+    __u64 samples;
+    __u32 count;
+    __u32 flags;
+    __s64 spacing;
+};
+
+/**
+ * Fill user buffer with samples of fake time of this open in one call
+ */
+#define FAKE_RTC_SAMPLE _IOW(FAKE_RTC_IOCTL_BASE, 0x05, struct fake_rtc_sample_request)
+
+/**
+ * Convert fake times to moments by CLOCK_MONOTONIC instead of moments to fake times
+ */
+#define FAKE_RTC_EVALUATE_INVERSE (1 << 0)
+
+/**
+ * @brief Argument of FAKE_RTC_EVALUATE
+ *
+ * Times are converted in place with current configuration, as if it did not change. Random coefficients and jitter
+ * are not predictable and are not applied. Moments before last synchronization are evaluated at synchronization.
+ * Inverse conversion gives the first moment when fake time of this open reaches given value, or moment not later
+ * than now if it is already reached. Trace mode is inverted with current offset of trace
+ *
+ * @times - user pointer to array of count __s64: moments by CLOCK_MONOTONIC or, with FAKE_RTC_EVALUATE_INVERSE,
+ *          fake times from January 1st 1970, in nanoseconds
+ * @count - number of times, from 1 to FAKE_RTC_MAX_SAMPLES
+ * @flags - FAKE_RTC_EVALUATE_* flags
+ */
+struct fake_rtc_evaluate_request {
+    __u64 times;
+    __u32 count;
+    __u32 flags;
+};
+
+/**
+ * Evaluate time transform of this open for array of moments or fake times in one call
+ */
+#define FAKE_RTC_EVALUATE _IOW(FAKE_RTC_IOCTL_BASE, 0x06, struct fake_rtc_evaluate_request)
+
+#endif
@@ -0,0 +1,560 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <linux/rtc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Load generator for fake RTC device
+ *
+ * Spawns threads pinned to CPUs, each issuing RTC_RD_TIME ioctls on the shared RTC device, reads of /proc/FakeRTC
+ * and RTC_SET_TIME ioctls at configurable ratios for a fixed duration. Runs every combination of thread count and
+ * mode and prints ops/sec and latency percentiles of every operation as CSV on stdout.
+ *
+ * RTC character device allows only one open file, so all threads share one descriptor like threads of one process
+ * do, and contention on ops_lock of RTC core is measured as is. Set operations write back time read by the same
+ * thread, so the clock only loses fractions of a second at every set.
+ */
+
+#define PROC_ENTRY "/proc/FakeRTC"
+#define RTC_CLASS "/sys/class/rtc"
+/* Name of platform device of module, parent of its RTC device */
+#define PLATFORM_DEVICE_NAME "FakeRTC"
+#define PROC_BUFFER_SIZE 8192
+#define NANOSECONDS_IN_SECOND 1000000000LL
+#define MAX_THREAD_COUNTS 64
+#define MAX_MODES 16
+
+/* Log-linear histogram: every power of two is split into 2^SUB_BITS buckets, so percentiles are within 1.6% */
+#define SUB_BITS 6
+#define SUB_BUCKETS (1 << SUB_BITS)
+/* Latencies from 2^MAX_EXPONENT ns (about 18 minutes) are counted in the last bucket */
+#define MAX_EXPONENT 40
+#define HISTOGRAM_BUCKETS ((MAX_EXPONENT - SUB_BITS + 1) * SUB_BUCKETS)
+
+enum operation {
+    OPERATION_READ,
+    OPERATION_PROC,
+    OPERATION_SET,
+    OPERATIONS_NUMBER
+};
+
+static const char *const operation_names[OPERATIONS_NUMBER] = {
+    [OPERATION_READ] = "rtc_read",
+    [OPERATION_PROC] = "proc_read",
+    [OPERATION_SET] = "rtc_set",
+};
+
+struct histogram {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+struct options {
+    const char *device;
+    unsigned int thread_counts[MAX_THREAD_COUNTS];
+    unsigned int thread_counts_number;
+    const char *modes[MAX_MODES];
+    unsigned int modes_number;
+    double duration;
+    double proc_ratio;
+    double set_ratio;
+    bool header;
+};
+
+struct worker {
+    pthread_t thread;
+    int cpu;
+    uint64_t random;
+    int error;
+    struct histogram histograms[OPERATIONS_NUMBER];
+};
+
+static struct options options = {
+    .duration = 5,
+    .header = true,
+};
+
+static int rtc_fd = -1;
+static int cpus[CPU_SETSIZE];
+static unsigned int cpus_number;
+/* Threads start operations together when main thread opens start gate */
+static pthread_mutex_t start_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int ready;
+static bool started;
+static volatile bool stop;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NANOSECONDS_IN_SECOND + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Index of histogram bucket of latency
+ */
+static unsigned int histogram_index(uint64_t value) {
+    unsigned int exponent;
+    if (value < SUB_BUCKETS) {
+        return (unsigned int)value;
+    }
+    exponent = 63 - (unsigned int)__builtin_clzll(value);
+    if (exponent >= MAX_EXPONENT) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    return (exponent - SUB_BITS + 1) * SUB_BUCKETS + (unsigned int)(value >> (exponent - SUB_BITS)) - SUB_BUCKETS;
+}
+
+/**
+ * @brief Largest latency counted in histogram bucket
+ */
+static uint64_t histogram_value(unsigned int index) {
+    unsigned int exponent;
+    uint64_t sub;
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    exponent = index / SUB_BUCKETS + SUB_BITS - 1;
+    sub = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub + 1) << (exponent - SUB_BITS)) - 1;
+}
+
+static void histogram_add(struct histogram *histogram, uint64_t value) {
+    histogram->count++;
+    histogram->buckets[histogram_index(value)]++;
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+static void histogram_merge(struct histogram *to, const struct histogram *from) {
+    unsigned int i;
+    to->count += from->count;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        to->buckets[i] += from->buckets[i];
+    }
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+}
+
+/**
+ * @brief Latency which the given fraction of operations did not exceed
+ * @return uint64_t - upper bound of bucket, but not more than maximum latency
+ */
+static uint64_t histogram_percentile(const struct histogram *histogram, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * (double)histogram->count);
+    uint64_t seen = 0;
+    unsigned int i;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen > rank) {
+            uint64_t value = histogram_value(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+/**
+ * @brief xorshift64* generator choosing operations, independent in every thread
+ */
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void *worker_run(void *arg) {
+    struct worker *worker = arg;
+    /* Random numbers are compared with thresholds scaled to 2^32 */
+    const uint64_t set_threshold = (uint64_t)(options.set_ratio * 4294967296.0);
+    const uint64_t proc_threshold = set_threshold + (uint64_t)(options.proc_ratio * 4294967296.0);
+    char buffer[PROC_BUFFER_SIZE];
+    struct rtc_time tm;
+    cpu_set_t set;
+    int proc_fd = -1;
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+    worker->error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (worker->error == 0 && options.proc_ratio > 0) {
+        proc_fd = open(PROC_ENTRY, O_RDONLY | O_CLOEXEC);
+        worker->error = proc_fd < 0 ? errno : 0;
+    }
+    if (worker->error == 0 && ioctl(rtc_fd, RTC_RD_TIME, &tm) < 0) {
+        worker->error = errno;
+    }
+    pthread_mutex_lock(&start_mutex);
+    ready++;
+    pthread_cond_broadcast(&start_cond);
+    while (!started) {
+        pthread_cond_wait(&start_cond, &start_mutex);
+    }
+    pthread_mutex_unlock(&start_mutex);
+    while (worker->error == 0 && !stop) {
+        uint64_t choice = next_random(&worker->random) >> 32;
+        enum operation operation = choice < set_threshold ? OPERATION_SET : choice < proc_threshold ? OPERATION_PROC : OPERATION_READ;
+        uint64_t start = now_ns();
+        int result;
+        switch (operation) {
+        case OPERATION_SET:
+            result = ioctl(rtc_fd, RTC_SET_TIME, &tm);
+            break;
+        case OPERATION_PROC:
+            result = pread(proc_fd, buffer, sizeof(buffer), 0) < 0 ? -1 : 0;
+            break;
+        default:
+            result = ioctl(rtc_fd, RTC_RD_TIME, &tm);
+            break;
+        }
+        if (result < 0) {
+            worker->error = errno;
+            break;
+        }
+        histogram_add(&worker->histograms[operation], now_ns() - start);
+    }
+    if (proc_fd >= 0) {
+        close(proc_fd);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Write commands to /proc/FakeRTC
+ * @return int - 0 on success, -1 with errno otherwise
+ */
+static int write_proc(const char *commands) {
+    size_t length = strlen(commands);
+    ssize_t written;
+    int fd = open(PROC_ENTRY, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    written = write(fd, commands, length);
+    if (written >= 0 && (size_t)written != length) {
+        errno = EIO;
+        written = -1;
+    }
+    close(fd);
+    return written < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Name of current mode from /proc/FakeRTC
+ * @return int - 0 on success, -1 otherwise
+ */
+static int read_mode(char *mode, size_t size) {
+    char buffer[PROC_BUFFER_SIZE];
+    char name[32];
+    const char *line;
+    ssize_t length;
+    int fd = open(PROC_ENTRY, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length < 0) {
+        return -1;
+    }
+    buffer[length] = '\0';
+    line = strstr(buffer, "Current operating mode: ");
+    if (line == NULL || sscanf(line, "Current operating mode: %*d (%31[^)])", name) != 1) {
+        errno = EPROTO;
+        return -1;
+    }
+    snprintf(mode, size, "%s", name);
+    return 0;
+}
+
+/**
+ * @brief Find RTC device registered by module in /sys/class/rtc
+ * @return int - 0 on success, -1 if module is not loaded
+ */
+static int find_device(char *path, size_t size) {
+    DIR *dir = opendir(RTC_CLASS);
+    struct dirent *entry;
+    int result = -1;
+    if (dir == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        char link[PATH_MAX];
+        char target[PATH_MAX];
+        const char *name;
+        ssize_t length;
+        if (strncmp(entry->d_name, "rtc", 3) != 0) {
+            continue;
+        }
+        snprintf(link, sizeof(link), RTC_CLASS "/%s/device", entry->d_name);
+        length = readlink(link, target, sizeof(target) - 1);
+        if (length < 0) {
+            continue;
+        }
+        target[length] = '\0';
+        name = strrchr(target, '/');
+        if (!strcmp(name != NULL ? name + 1 : target, PLATFORM_DEVICE_NAME)) {
+            snprintf(path, size, "/dev/%s", entry->d_name);
+            result = 0;
+            break;
+        }
+    }
+    closedir(dir);
+    if (result < 0) {
+        errno = ENODEV;
+    }
+    return result;
+}
+
+/**
+ * @brief Run one thread count in current mode and print CSV rows
+ * @return int - 0 on success, errno of failed operation otherwise
+ */
+static int run(const char *mode, unsigned int threads) {
+    struct worker *workers = calloc(threads, sizeof(*workers));
+    struct histogram *total = calloc(1, sizeof(*total));
+    uint64_t start;
+    double elapsed;
+    unsigned int i;
+    int error = 0;
+    int operation;
+    if (workers == NULL || total == NULL) {
+        free(workers);
+        free(total);
+        return ENOMEM;
+    }
+    stop = false;
+    ready = 0;
+    started = false;
+    for (i = 0; i < threads; i++) {
+        workers[i].cpu = cpus[i % cpus_number];
+        workers[i].random = 0x9E3779B97F4A7C15ULL * (i + 1);
+        error = pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+        if (error != 0) {
+            /* Already created threads are released with zero duration */
+            threads = i;
+            stop = true;
+            break;
+        }
+    }
+    pthread_mutex_lock(&start_mutex);
+    while (ready < threads) {
+        pthread_cond_wait(&start_cond, &start_mutex);
+    }
+    started = true;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_mutex);
+    start = now_ns();
+    if (error == 0) {
+        struct timespec duration = {
+            .tv_sec = (time_t)options.duration,
+            .tv_nsec = (long)((options.duration - (double)(time_t)options.duration) * NANOSECONDS_IN_SECOND),
+        };
+        while (nanosleep(&duration, &duration) < 0 && errno == EINTR) {
+        }
+    }
+    stop = true;
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    elapsed = (double)(now_ns() - start) / NANOSECONDS_IN_SECOND;
+    for (i = 0; i < threads && error == 0; i++) {
+        error = workers[i].error;
+    }
+    for (operation = 0; operation < OPERATIONS_NUMBER && error == 0; operation++) {
+        memset(total, 0, sizeof(*total));
+        for (i = 0; i < threads; i++) {
+            histogram_merge(total, &workers[i].histograms[operation]);
+        }
+        if (total->count == 0) {
+            continue;
+        }
+        printf("%s,%u,%s,%" PRIu64 ",%.0f,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n", mode, threads,
+            operation_names[operation], total->count, (double)total->count / elapsed, histogram_percentile(total, 0.5),
+            histogram_percentile(total, 0.99), histogram_percentile(total, 0.999), total->max);
+    }
+    fflush(stdout);
+    free(workers);
+    free(total);
+    return error;
+}
+
+static int parse_thread_counts(char *list) {
+    char *token;
+    char *save;
+    options.thread_counts_number = 0;
+    for (token = strtok_r(list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+        char *end;
+        unsigned long count = strtoul(token, &end, 10);
+        if (*end != '\0' || count == 0 || count > 4096 || options.thread_counts_number == MAX_THREAD_COUNTS) {
+            return -1;
+        }
+        options.thread_counts[options.thread_counts_number++] = (unsigned int)count;
+    }
+    return options.thread_counts_number == 0 ? -1 : 0;
+}
+
+static int parse_modes(char *list) {
+    char *token;
+    char *save;
+    options.modes_number = 0;
+    for (token = strtok_r(list, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+        if (options.modes_number == MAX_MODES) {
+            return -1;
+        }
+        options.modes[options.modes_number++] = token;
+    }
+    return options.modes_number == 0 ? -1 : 0;
+}
+
+static int parse_ratio(const char *str, double *ratio) {
+    char *end;
+    *ratio = strtod(str, &end);
+    return *end != '\0' || !(*ratio >= 0 && *ratio <= 1) ? -1 : 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-d device] [-t threads,...] [-m mode,...] [-s seconds] [-p proc ratio] [-w set ratio] [-n]\n"\
+        "\t-d - RTC device of module, found in " RTC_CLASS " by default\n"\
+        "\t-t - thread counts to run, number of CPUs by default\n"\
+        "\t-m - modes to switch to through " PROC_ENTRY ", current mode by default\n"\
+        "\t-s - duration of every run in seconds, 5 by default\n"\
+        "\t-p - fraction of operations reading " PROC_ENTRY ", 0 by default\n"\
+        "\t-w - fraction of operations setting time, 0 by default\n"\
+        "\t-n - do not print CSV header\n", name);
+}
+
+int main(int argc, char **argv) {
+    char device[PATH_MAX];
+    char initial_mode[32];
+    cpu_set_t affinity;
+    unsigned int mode;
+    unsigned int i;
+    int error = 0;
+    int option;
+    while ((option = getopt(argc, argv, "d:t:m:s:p:w:nh")) != -1) {
+        switch (option) {
+        case 'd':
+            options.device = optarg;
+            break;
+        case 't':
+            if (parse_thread_counts(optarg) < 0) {
+                fprintf(stderr, "Invalid thread counts\n");
+                return 1;
+            }
+            break;
+        case 'm':
+            if (parse_modes(optarg) < 0) {
+                fprintf(stderr, "Invalid modes\n");
+                return 1;
+            }
+            break;
+        case 's':
+            options.duration = strtod(optarg, NULL);
+            if (!(options.duration > 0 && options.duration < 86400)) {
+                fprintf(stderr, "Invalid duration\n");
+                return 1;
+            }
+            break;
+        case 'p':
+            if (parse_ratio(optarg, &options.proc_ratio) < 0) {
+                fprintf(stderr, "Invalid ratio of /proc reads\n");
+                return 1;
+            }
+            break;
+        case 'w':
+            if (parse_ratio(optarg, &options.set_ratio) < 0) {
+                fprintf(stderr, "Invalid ratio of sets\n");
+                return 1;
+            }
+            break;
+        case 'n':
+            options.header = false;
+            break;
+        default:
+            usage(argv[0]);
+            return option == 'h' ? 0 : 1;
+        }
+    }
+    if (options.proc_ratio + options.set_ratio > 1) {
+        fprintf(stderr, "Ratios of /proc reads and sets exceed 1\n");
+        return 1;
+    }
+
+    if (sched_getaffinity(0, sizeof(affinity), &affinity) < 0) {
+        perror("sched_getaffinity");
+        return 1;
+    }
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &affinity)) {
+            cpus[cpus_number++] = (int)i;
+        }
+    }
+    if (options.thread_counts_number == 0) {
+        options.thread_counts[options.thread_counts_number++] = cpus_number;
+    }
+    if (options.device == NULL) {
+        if (find_device(device, sizeof(device)) < 0) {
+            fprintf(stderr, "RTC device of module is not found in " RTC_CLASS ", is module loaded?\n");
+            return 1;
+        }
+        options.device = device;
+    }
+    if (read_mode(initial_mode, sizeof(initial_mode)) < 0) {
+        perror(PROC_ENTRY);
+        return 1;
+    }
+    if (options.modes_number == 0) {
+        options.modes[options.modes_number++] = initial_mode;
+    }
+    rtc_fd = open(options.device, O_RDWR | O_CLOEXEC);
+    if (rtc_fd < 0) {
+        perror(options.device);
+        return 1;
+    }
+
+    if (options.header) {
+        printf("mode,threads,operation,ops,ops_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+    for (mode = 0; mode < options.modes_number && error == 0; mode++) {
+        char commands[64];
+        char current[32];
+        snprintf(commands, sizeof(commands), "mode=%s\n", options.modes[mode]);
+        if (write_proc(commands) < 0 || read_mode(current, sizeof(current)) < 0) {
+            fprintf(stderr, "Switching to mode %s failed: %s\n", options.modes[mode], strerror(errno));
+            error = errno;
+            break;
+        }
+        for (i = 0; i < options.thread_counts_number && error == 0; i++) {
+            error = run(current, options.thread_counts[i]);
+            if (error != 0) {
+                fprintf(stderr, "Run of %u threads in mode %s failed: %s\n", options.thread_counts[i], current, strerror(error));
+            }
+        }
+    }
+
+    if (options.modes[0] != initial_mode) {
+        char commands[64];
+        snprintf(commands, sizeof(commands), "mode=%s\n", initial_mode);
+        if (write_proc(commands) < 0) {
+            fprintf(stderr, "Restoring mode %s failed: %s\n", initial_mode, strerror(errno));
+        }
+    }
+    close(rtc_fd);
+    return error == 0 ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "fake_rtc_transform.h"
+
+/**
+ * Microbenchmark of time transform shared with module
+ *
+ * Measures cost of calculating fake time from elapsed nanoseconds in every mode, the same calculation as
+ * module does after reading CLOCK_MONOTONIC. Usage: fake_rtc_transform_bench [iterations]
+ */
+
+#define DEFAULT_ITERATIONS 20000000ULL
+#define NANOSECONDS_IN_SECOND 1000000000LL
+/* Elapsed time grows by odd step, so schedule and trace lookups touch different segments and samples */
+#define ELAPSED_STEP 977
+#define SCHEDULE_SEGMENTS 1024
+#define TRACE_SAMPLES (1 << 20)
+
+static volatile s64 sink;
+
+static double seconds_between(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * Run expression for every iteration with elapsed nanoseconds in "elapsed" and print ns/op
+ * Loop is expanded in place, so the benchmark measures inlined code like in module
+ */
+#define BENCH(name, expression) do { \
+    struct timespec start; \
+    struct timespec end; \
+    s64 sum = 0; \
+    u64 iteration; \
+    clock_gettime(CLOCK_MONOTONIC, &start); \
+    for (iteration = 0; iteration < iterations; iteration++) { \
+        u64 elapsed = iteration * ELAPSED_STEP; \
+        sum += (expression); \
+    } \
+    clock_gettime(CLOCK_MONOTONIC, &end); \
+    sink += sum; \
+    printf("%-10s %8.2f\n", name, seconds_between(&start, &end) * 1e9 / iterations); \
+} while (0)
+
+int main(int argc, char **argv) {
+    u64 iterations = argc > 1 ? strtoull(argv[1], NULL, 0) : DEFAULT_ITERATIONS;
+    const ktime_t real_time = 50 * 365LL * 86400 * NANOSECONDS_IN_SECOND;
+    const ktime_t boot_time = 1000 * NANOSECONDS_IN_SECOND;
+    struct fake_rtc_segment *segments = calloc(SCHEDULE_SEGMENTS, sizeof(*segments));
+    s64 *offsets = malloc(TRACE_SAMPLES * sizeof(*offsets));
+    struct fake_rtc_samples samples = { .count = TRACE_SAMPLES, .offsets = offsets };
+    u32 random_state[4];
+    s64 real_mult, accelerated_mult, slowed_mult;
+    u32 real_shift, accelerated_shift, slowed_shift;
+    s64 inverse_mult;
+    u32 inverse_shift;
+    bool saturated;
+    unsigned int i;
+    if (iterations == 0 || segments == NULL || offsets == NULL) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+    fake_rtc_rate_to_fixed(1, 1, &real_mult, &real_shift);
+    fake_rtc_rate_to_fixed(37, 10, &accelerated_mult, &accelerated_shift);
+    fake_rtc_rate_to_fixed(1, 5, &slowed_mult, &slowed_shift);
+    fake_rtc_rate_to_fixed(10, 37, &inverse_mult, &inverse_shift);
+    fake_rtc_random_init(random_state, 42, 0);
+    /* Schedule covers the whole run: segments with rates 1..8 and jumps between them */
+    for (i = 0; i < SCHEDULE_SEGMENTS; i++) {
+        u64 duration = iterations * ELAPSED_STEP / SCHEDULE_SEGMENTS + 1;
+        segments[i].real_start = i * duration;
+        segments[i].fake_start = i * duration * 4 + (i % 3) * NANOSECONDS_IN_SECOND;
+        fake_rtc_rate_to_fixed(i % 8 + 1, 1, &segments[i].mult, &segments[i].shift);
+        fake_rtc_rate_to_fixed(1, i % 8 + 1, &segments[i].inverse_mult, &segments[i].inverse_shift);
+    }
+    samples.interval = iterations * ELAPSED_STEP / TRACE_SAMPLES + 1;
+    fake_rtc_rate_to_fixed(1, samples.interval, &samples.inverse_mult, &samples.inverse_shift);
+    for (i = 0; i < TRACE_SAMPLES; i++) {
+        offsets[i] = (s64)(i % 1000) * 37 - 18500;
+    }
+
+    printf("%-10s %8s\n", "mode", "ns/op");
+    BENCH("real", fake_rtc_scale(real_time, elapsed, real_mult, real_shift, &saturated));
+    BENCH("random", fake_rtc_scale(real_time, elapsed, fake_rtc_random_coefficient(fake_rtc_random_next(random_state), -9, 19), 0,
+        &saturated));
+    BENCH("accel", fake_rtc_scale(real_time, elapsed, accelerated_mult, accelerated_shift, &saturated));
+    BENCH("slow", fake_rtc_scale(real_time, elapsed, slowed_mult, slowed_shift, &saturated));
+    BENCH("schedule", fake_rtc_schedule_time(real_time, segments, SCHEDULE_SEGMENTS, elapsed, &saturated));
+    BENCH("trace", fake_rtc_trace_time(real_time, &samples, elapsed, &saturated));
+    BENCH("inverse", fake_rtc_inverse_scale(real_time, boot_time, real_time + elapsed, inverse_mult, inverse_shift));
+    BENCH("deadline", fake_rtc_schedule_deadline(real_time, boot_time, segments, SCHEDULE_SEGMENTS,
+        real_time + elapsed * 4, boot_time + elapsed));
+    free(segments);
+    free(offsets);
+    return 0;
+}
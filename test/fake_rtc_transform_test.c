@@ -0,0 +1,364 @@
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "fake_rtc_transform.h"
+
+/**
+ * Unit tests of time transform shared with module
+ *
+ * Built twice by "make test": with 128-bit multiplication and with FAKE_RTC_NO_INT128,
+ * so both implementations of mul_u64_u64_shr_sat are checked against the same expectations
+ */
+
+#define NANOSECONDS_IN_SECOND 1000000000LL
+#define YEAR (365LL * 86400 * NANOSECONDS_IN_SECOND)
+
+static int checks;
+static int failures;
+
+#define CHECK(condition) do { \
+    checks++; \
+    if (!(condition)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+} while (0)
+
+#define CHECK_EQUAL(actual, expected) do { \
+    int64_t actual_value = (int64_t)(actual); \
+    int64_t expected_value = (int64_t)(expected); \
+    checks++; \
+    if (actual_value != expected_value) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: %s is %" PRId64 ", expected %" PRId64 "\n", __FILE__, __LINE__, #actual, actual_value, expected_value); \
+    } \
+} while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) do { \
+    int64_t actual_value = (int64_t)(actual); \
+    int64_t expected_value = (int64_t)(expected); \
+    checks++; \
+    if (actual_value < expected_value - (tolerance) || actual_value > expected_value + (tolerance)) { \
+        failures++; \
+        fprintf(stderr, "%s:%d: %s is %" PRId64 ", expected %" PRId64 " +- %d\n", __FILE__, __LINE__, #actual, actual_value, \
+            expected_value, (tolerance)); \
+    } \
+} while (0)
+
+/**
+ * @brief Fixed point rate num / den as used by module
+ */
+struct rate {
+    s64 mult;
+    u32 shift;
+    s64 inverse_mult;
+    u32 inverse_shift;
+};
+
+static struct rate make_rate(u64 num, u64 den) {
+    struct rate rate;
+    fake_rtc_rate_to_fixed(num, den, &rate.mult, &rate.shift);
+    fake_rtc_rate_to_fixed(den, num, &rate.inverse_mult, &rate.inverse_shift);
+    return rate;
+}
+
+static void test_mul_u64_u64_shr_sat(void) {
+    CHECK_EQUAL(mul_u64_u64_shr_sat(0, U64_MAX, 0), 0);
+    CHECK_EQUAL(mul_u64_u64_shr_sat(3, 5 << 10, 10), 15);
+    CHECK_EQUAL(mul_u64_u64_shr_sat(7, 1, 1), 3);
+    CHECK(mul_u64_u64_shr_sat(U64_MAX, 1, 0) == U64_MAX);
+    CHECK(mul_u64_u64_shr_sat(U64_MAX, 2, 0) == U64_MAX);
+    CHECK(mul_u64_u64_shr_sat(U64_MAX, 2, 1) == U64_MAX);
+    CHECK(mul_u64_u64_shr_sat(U64_MAX, 1ULL << 62, 62) == U64_MAX);
+    CHECK(mul_u64_u64_shr_sat(U64_MAX, 1ULL << 62, 63) == U64_MAX >> 1);
+    CHECK(mul_u64_u64_shr_sat(1ULL << 32, 1ULL << 32, 0) == U64_MAX);
+    CHECK(mul_u64_u64_shr_sat(1ULL << 32, 1ULL << 32, 1) == 1ULL << 63);
+    CHECK(mul_u64_u64_shr_sat(1ULL << 32, 1ULL << 31, 0) == 1ULL << 63);
+    /* Carries between 32-bit halves */
+    CHECK(mul_u64_u64_shr_sat(0xFFFFFFFFULL, 0xFFFFFFFFULL, 0) == 0xFFFFFFFE00000001ULL);
+    CHECK(mul_u64_u64_shr_sat(0x1FFFFFFFFULL, 0x1FFFFFFFFULL, 4) == 0x3FFFFFFFC0000000ULL);
+}
+
+static void test_rate_to_fixed(void) {
+    struct rate rate = make_rate(1, 1);
+    CHECK_EQUAL(rate.mult, 1LL << 62);
+    CHECK_EQUAL(rate.shift, 62);
+    rate = make_rate(2, 1);
+    CHECK_EQUAL(rate.mult, 1LL << 62);
+    CHECK_EQUAL(rate.shift, 61);
+    /* Rates above 1 use all 63 bits of multiplier, smaller ones have shift 63 */
+    rate = make_rate(1, 3);
+    CHECK_EQUAL(rate.shift, 63);
+    CHECK_EQUAL(mul_u64_u64_shr_sat(3 * NANOSECONDS_IN_SECOND, rate.mult, rate.shift), NANOSECONDS_IN_SECOND - 1);
+    rate = make_rate(37, 10);
+    CHECK_EQUAL(mul_u64_u64_shr_sat(10 * NANOSECONDS_IN_SECOND, rate.mult, rate.shift), 37 * NANOSECONDS_IN_SECOND - 1);
+    /* Largest rate accepted by module: UINT32_MAX with +50% correction */
+    rate = make_rate(0xFFFFFFFFULL * 1500000000ULL, 1000000000ULL);
+    CHECK(rate.mult >= 1LL << 62);
+    CHECK_EQUAL(mul_u64_u64_shr_sat(2, rate.mult, rate.shift), 0xFFFFFFFFULL * 3);
+    /* Smallest one: 1 / UINT32_MAX with -50% correction */
+    rate = make_rate(500000000ULL, 0xFFFFFFFFULL * 1000000000ULL);
+    CHECK_EQUAL(mul_u64_u64_shr_sat(0xFFFFFFFFULL * 4, rate.mult, rate.shift), 1);
+}
+
+static void test_add_sat(void) {
+    bool saturated;
+    CHECK_EQUAL(fake_rtc_add_sat(10, -3, &saturated), 7);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_add_sat(MAX_FAKE_TIME - 1, 1, &saturated), MAX_FAKE_TIME);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_add_sat(MAX_FAKE_TIME - 1, 2, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+    CHECK_EQUAL(fake_rtc_add_sat(MAX_FAKE_TIME, INT64_MAX, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+    CHECK_EQUAL(fake_rtc_add_sat(1, -1, &saturated), MIN_FAKE_TIME);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_add_sat(1, -2, &saturated), MIN_FAKE_TIME);
+    CHECK(saturated);
+    CHECK_EQUAL(fake_rtc_add_sat(0, INT64_MIN, &saturated), MIN_FAKE_TIME);
+    CHECK(saturated);
+}
+
+static void test_scale(void) {
+    struct rate rate = make_rate(1, 1);
+    bool saturated;
+    CHECK_EQUAL(fake_rtc_scale(YEAR, 5, rate.mult, rate.shift, &saturated), YEAR + 5);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_scale(MAX_FAKE_TIME, 0, rate.mult, rate.shift, &saturated), MAX_FAKE_TIME);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_scale(MAX_FAKE_TIME - 10, 10, rate.mult, rate.shift, &saturated), MAX_FAKE_TIME);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_scale(MAX_FAKE_TIME - 10, 11, rate.mult, rate.shift, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+    /* Elapsed time which doesn't fit in 64 bits after multiplication */
+    rate = make_rate(1000000000, 1);
+    CHECK_EQUAL(fake_rtc_scale(0, U64_MAX, rate.mult, rate.shift, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+    CHECK_EQUAL(fake_rtc_scale(0, 1000, rate.mult, rate.shift, &saturated), 1000000000000LL);
+    CHECK(!saturated);
+    /* Time going backwards stops at the beginning of range */
+    CHECK_EQUAL(fake_rtc_scale(100, 10, -9, 0, &saturated), 10);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_scale(100, 10, -10, 0, &saturated), MIN_FAKE_TIME);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_scale(100, 11, -10, 0, &saturated), MIN_FAKE_TIME);
+    CHECK(saturated);
+    CHECK_EQUAL(fake_rtc_scale(100, U64_MAX, INT64_MIN + 1, 0, &saturated), MIN_FAKE_TIME);
+    CHECK(saturated);
+    CHECK_EQUAL(fake_rtc_scale(100, 1, 0, 0, &saturated), 100);
+    CHECK(!saturated);
+}
+
+static void test_inverse_scale(void) {
+    static const u64 rates[][2] = { { 1, 1 }, { 2, 1 }, { 37, 10 }, { 1, 5 }, { 1, 3600 }, { 1000000000, 1 }, { 1000000001, 1000000000 } };
+    const ktime_t base = 50 * YEAR;
+    const ktime_t boot_time = 1000 * NANOSECONDS_IN_SECOND;
+    unsigned int i;
+    for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        struct rate rate = make_rate(rates[i][0], rates[i][1]);
+        static const s64 targets[] = { 1, 999, NANOSECONDS_IN_SECOND, 86400 * NANOSECONDS_IN_SECOND + 7, YEAR };
+        unsigned int j;
+        for (j = 0; j < sizeof(targets) / sizeof(targets[0]); j++) {
+            ktime_t fake_time = base + targets[j];
+            ktime_t deadline = fake_rtc_inverse_scale(base, boot_time, fake_time, rate.inverse_mult, rate.inverse_shift);
+            bool saturated;
+            if (deadline == KTIME_MAX) {
+                /* Slow rate doesn't reach fake time before the end of range */
+                CHECK(fake_rtc_scale(base, KTIME_MAX - boot_time, rate.mult, rate.shift, &saturated) < fake_time);
+                continue;
+            }
+            /* Deadline is within a nanosecond of exact inverse, forward transform is rounded down by a nanosecond */
+            CHECK(fake_rtc_scale(base, deadline - boot_time + 1, rate.mult, rate.shift, &saturated) >= fake_time - 1);
+            if (deadline - boot_time >= 2) {
+                CHECK(fake_rtc_scale(base, deadline - boot_time - 2, rate.mult, rate.shift, &saturated) < fake_time);
+            }
+        }
+    }
+    CHECK_EQUAL(fake_rtc_inverse_scale(base, boot_time, base, 1, 0), boot_time);
+    CHECK_EQUAL(fake_rtc_inverse_scale(base, boot_time, base - 1, 1, 0), boot_time);
+    CHECK_EQUAL(fake_rtc_inverse_scale(0, boot_time, MAX_FAKE_TIME, 1, 0), KTIME_MAX);
+    CHECK_EQUAL(fake_rtc_inverse_scale(0, KTIME_MAX - 5, 10, 1, 0), KTIME_MAX);
+}
+
+static void test_random_coefficient(void) {
+    CHECK_EQUAL(fake_rtc_random_coefficient(0, -9, 19), -9);
+    CHECK_EQUAL(fake_rtc_random_coefficient(UINT32_MAX, -9, 19), 9);
+    CHECK_EQUAL(fake_rtc_random_coefficient(1U << 31, -9, 19), 0);
+    CHECK_EQUAL(fake_rtc_random_coefficient(UINT32_MAX, 5, 1), 5);
+    CHECK_EQUAL(fake_rtc_random_coefficient(0, INT32_MIN, 1ULL << 32), INT32_MIN);
+    CHECK_EQUAL(fake_rtc_random_coefficient(UINT32_MAX, INT32_MIN, 1ULL << 32), INT32_MAX);
+}
+
+static void test_random_generator(void) {
+    u32 state[4] = { 1, 2, 3, 4 };
+    u32 first[4];
+    u32 second[4];
+    /* Reference values of xoshiro128** */
+    CHECK_EQUAL(fake_rtc_random_next(state), 11520);
+    CHECK_EQUAL(fake_rtc_random_next(state), 0);
+    CHECK_EQUAL(fake_rtc_random_next(state), 5927040);
+    fake_rtc_random_init(first, 42, 3);
+    fake_rtc_random_init(second, 42, 3);
+    CHECK(first[0] == second[0] && first[1] == second[1] && first[2] == second[2] && first[3] == second[3]);
+    CHECK_EQUAL(fake_rtc_random_next(first), fake_rtc_random_next(second));
+    fake_rtc_random_init(second, 42, 4);
+    CHECK(first[0] != second[0] || first[1] != second[1] || first[2] != second[2] || first[3] != second[3]);
+}
+
+/**
+ * @brief Append segment the same way as module parses schedule
+ */
+static void append_segment(struct fake_rtc_segment *segments, unsigned int *count, u64 *real_start, s64 *fake_start,
+        s64 duration, u64 num, u64 den) {
+    struct fake_rtc_segment *segment = &segments[(*count)++];
+    segment->real_start = *real_start;
+    segment->fake_start = *fake_start;
+    fake_rtc_rate_to_fixed(num, den, &segment->mult, &segment->shift);
+    fake_rtc_rate_to_fixed(den, num, &segment->inverse_mult, &segment->inverse_shift);
+    if (duration >= 0) {
+        *fake_start += mul_u64_u64_shr_sat(duration, segment->mult, segment->shift);
+        *real_start += duration;
+    }
+}
+
+static void test_schedule(void) {
+    /* "10s@1,60s@100,+1y,30s@0.2" followed by real rate */
+    const s64 second = NANOSECONDS_IN_SECOND;
+    const ktime_t real_time = 50 * YEAR;
+    const ktime_t boot_time = 1000 * second;
+    struct fake_rtc_segment segments[5];
+    unsigned int count = 0;
+    u64 real_start = 0;
+    s64 fake_start = 0;
+    bool saturated;
+    append_segment(segments, &count, &real_start, &fake_start, 10 * second, 1, 1);
+    append_segment(segments, &count, &real_start, &fake_start, 60 * second, 100, 1);
+    fake_start += YEAR;
+    append_segment(segments, &count, &real_start, &fake_start, 30 * second, 1, 5);
+    append_segment(segments, &count, &real_start, &fake_start, -1, 1, 1);
+
+    CHECK_EQUAL(fake_rtc_find_segment(segments, count, 0), 0);
+    CHECK_EQUAL(fake_rtc_find_segment(segments, count, 10 * second - 1), 0);
+    CHECK_EQUAL(fake_rtc_find_segment(segments, count, 10 * second), 1);
+    CHECK_EQUAL(fake_rtc_find_segment(segments, count, 70 * second), 2);
+    CHECK_EQUAL(fake_rtc_find_segment(segments, count, 100 * second), 3);
+    CHECK_EQUAL(fake_rtc_find_segment(segments, count, U64_MAX), 3);
+
+    CHECK_EQUAL(fake_rtc_schedule_time(real_time, segments, count, 5 * second, &saturated), real_time + 5 * second);
+    CHECK_EQUAL(fake_rtc_schedule_time(real_time, segments, count, 20 * second, &saturated), real_time + 1010 * second);
+    CHECK_EQUAL(fake_rtc_schedule_time(real_time, segments, count, 70 * second, &saturated), real_time + 6010 * second + YEAR);
+    CHECK(fake_rtc_schedule_time(real_time, segments, count, 100 * second, &saturated) - (real_time + 6016 * second + YEAR) >= -1);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_schedule_time(MAX_FAKE_TIME - YEAR, segments, count, 70 * second, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+
+    /* Deadline inside the same segment, across the jump and after the end of schedule */
+    CHECK_EQUAL(fake_rtc_schedule_deadline(real_time, boot_time, segments, count, real_time + 5 * second, boot_time),
+        boot_time + 5 * second + 1);
+    CHECK_EQUAL(fake_rtc_schedule_deadline(real_time, boot_time, segments, count, real_time + 6010 * second, boot_time),
+        boot_time + 70 * second);
+    CHECK_EQUAL(fake_rtc_schedule_deadline(real_time, boot_time, segments, count, real_time + YEAR + 6110 * second, boot_time),
+        boot_time + 194 * second + 2);
+    /* Time already reached */
+    CHECK_EQUAL(fake_rtc_schedule_deadline(real_time, boot_time, segments, count, real_time, boot_time + 20 * second),
+        boot_time + 10 * second);
+}
+
+static void test_trace(void) {
+    static const s64 offsets[] = { 0, 100, -50, -50, 1000000 };
+    struct fake_rtc_samples samples = { .interval = 1000, .count = 5, .offsets = offsets };
+    s64 reference[1000];
+    bool saturated;
+    u64 interval;
+    fake_rtc_rate_to_fixed(1, samples.interval, &samples.inverse_mult, &samples.inverse_shift);
+    CHECK(samples.inverse_shift >= 32);
+    CHECK_EQUAL(fake_rtc_trace_offset(&samples, 0), 0);
+    /* Fraction of interval is rounded down, so interpolated offset is rounded towards the earlier sample */
+    CHECK_NEAR(fake_rtc_trace_offset(&samples, 500), 50, 1);
+    CHECK_EQUAL(fake_rtc_trace_offset(&samples, 1000), 100);
+    CHECK_NEAR(fake_rtc_trace_offset(&samples, 1500), 25, 1);
+    CHECK_EQUAL(fake_rtc_trace_offset(&samples, 2500), -50);
+    CHECK_EQUAL(fake_rtc_trace_offset(&samples, 4000), 1000000);
+    CHECK_EQUAL(fake_rtc_trace_offset(&samples, U64_MAX), 1000000);
+    CHECK_NEAR(fake_rtc_trace_time(YEAR, &samples, 1500, &saturated), YEAR + 1525, 1);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_trace_time(YEAR, &samples, U64_MAX, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+    /* Negative offset near the beginning of range */
+    CHECK_EQUAL(fake_rtc_trace_time(10, &samples, 2000, &saturated), 1960);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_trace_time(10, &samples, 1000, &saturated), 1110);
+    CHECK_EQUAL(fake_rtc_trace_time(MAX_FAKE_TIME - 1000, &samples, 4000, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+
+    /* Index found by multiplication is corrected for every interval and moment */
+    samples.count = sizeof(reference) / sizeof(reference[0]);
+    samples.offsets = reference;
+    for (interval = 0; interval < samples.count; interval++) {
+        reference[interval] = interval * 10;
+    }
+    for (interval = 1; interval < 200; interval += 7) {
+        u64 elapsed;
+        int mismatches = 0;
+        samples.interval = interval;
+        fake_rtc_rate_to_fixed(1, interval, &samples.inverse_mult, &samples.inverse_shift);
+        for (elapsed = 0; elapsed < interval * samples.count + 50; elapsed++) {
+            s64 expected = elapsed >= interval * (samples.count - 1) ? reference[samples.count - 1] : (s64)(elapsed * 10 / interval);
+            s64 offset = fake_rtc_trace_offset(&samples, elapsed);
+            /* Fraction has 32 bits, so interpolation may be rounded down by one */
+            mismatches += offset != expected && offset != expected - 1;
+        }
+        CHECK_EQUAL(mismatches, 0);
+    }
+}
+
+static void test_timeline(void) {
+    struct rate tenfold = make_rate(10, 1);
+    struct rate slowed = make_rate(1, 4);
+    bool saturated;
+    CHECK_EQUAL(fake_rtc_timeline_time(YEAR + 5, YEAR, YEAR, tenfold.mult, tenfold.shift, &saturated), YEAR + 5);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_timeline_time(YEAR + 5, YEAR, YEAR + 100, tenfold.mult, tenfold.shift, &saturated), YEAR + 1005);
+    CHECK_NEAR(fake_rtc_timeline_time(YEAR, YEAR, YEAR + 1000, slowed.mult, slowed.shift, &saturated), YEAR + 250, 1);
+    /* Device time set back before anchor */
+    CHECK_EQUAL(fake_rtc_timeline_time(YEAR, YEAR, YEAR - 100, tenfold.mult, tenfold.shift, &saturated), YEAR - 1000);
+    CHECK(!saturated);
+    CHECK_EQUAL(fake_rtc_timeline_time(100, YEAR, 0, tenfold.mult, tenfold.shift, &saturated), MIN_FAKE_TIME);
+    CHECK(saturated);
+    CHECK_EQUAL(fake_rtc_timeline_time(YEAR, 0, MAX_FAKE_TIME, tenfold.mult, tenfold.shift, &saturated), MAX_FAKE_TIME);
+    CHECK(saturated);
+}
+
+static void test_periodic_ticks(void) {
+    ktime_t next = 1000;
+    /* Timer fires just after deadline */
+    CHECK_EQUAL(fake_rtc_periodic_ticks(&next, 1001, 100), 1);
+    CHECK_EQUAL(next, 1100);
+    CHECK_EQUAL(fake_rtc_periodic_ticks(&next, 1099, 100), 0);
+    CHECK_EQUAL(next, 1100);
+    CHECK_EQUAL(fake_rtc_periodic_ticks(&next, 1100, 100), 1);
+    CHECK_EQUAL(next, 1200);
+    /* Late timer reports all passed periods at once */
+    CHECK_EQUAL(fake_rtc_periodic_ticks(&next, 1550, 100), 4);
+    CHECK_EQUAL(next, 1600);
+    /* Fake time moved backwards */
+    CHECK_EQUAL(fake_rtc_periodic_ticks(&next, 500, 100), 0);
+    CHECK_EQUAL(next, 600);
+    CHECK_EQUAL(fake_rtc_periodic_ticks(&next, YEAR, NANOSECONDS_IN_SECOND / 8192), (YEAR - 600) / (NANOSECONDS_IN_SECOND / 8192) + 1);
+}
+
+int main(void) {
+    test_mul_u64_u64_shr_sat();
+    test_rate_to_fixed();
+    test_add_sat();
+    test_scale();
+    test_inverse_scale();
+    test_random_coefficient();
+    test_random_generator();
+    test_schedule();
+    test_trace();
+    test_timeline();
+    test_periodic_ticks();
+    printf("%d of %d checks failed\n", failures, checks);
+    return failures == 0 ? 0 : 1;
+}